@@ -0,0 +1,300 @@
+/*
+ * Rozšírenia binárneho vyhľadávacieho stromu nad rámec rozhrania btree.h.
+ */
+
+#ifndef IAL_BTREE_EXT_H
+#define IAL_BTREE_EXT_H
+
+#include "btree.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Počet položiek zásobníku bst_stack_t uložených priamo v štruktúre.
+ */
+#define BST_STACK_INLINE 32
+
+/*
+ * Rastúci zásobník uzlov pre iteratívne prechody.
+ *
+ * Začína vo vnútornom poli a pri zaplnení sa jeho kapacita zdvojnásobí.
+ * Volajúci ho môže použiť opakovane pre ľubovoľný počet prechodov, pamäť sa
+ * uvoľní až funkciou bst_stack_dispose.
+ */
+typedef struct bst_stack
+{
+	bst_node_t **items;
+	int top;
+	int capacity;
+	bst_node_t *inline_items[BST_STACK_INLINE];
+} bst_stack_t;
+
+/*
+ * Poradie spracovania uzlov pri prechode stromom.
+ */
+typedef enum bst_order
+{
+	BST_PREORDER,
+	BST_INORDER,
+	BST_POSTORDER
+} bst_order_t;
+
+/*
+ * Funkcia volaná pre každý spracovávaný uzol. Návratová hodnota false
+ * prechod predčasne ukončí.
+ */
+typedef bool (*bst_visitor_t)(bst_node_t *node, void *context);
+
+/*
+ * Funkcia volaná pre pole až BST_VISIT_BATCH uzlov v poradí prechodu.
+ * Návratová hodnota false prechod predčasne ukončí.
+ */
+typedef bool (*bst_batch_visitor_t)(bst_node_t **nodes, int count,
+									void *context);
+
+#define BST_VISIT_BATCH 64
+
+/*
+ * Prechod stromom v poradí order, ktorý pre každý uzol zavolá visit.
+ *
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil.
+ */
+bool bst_visit(bst_node_t *tree, bst_order_t order, bst_visitor_t visit,
+			   void *context);
+
+/*
+ * Prechod stromom v poradí order, ktorý odovzdáva uzly po poliach.
+ *
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil.
+ */
+bool bst_visit_batch(bst_node_t *tree, bst_order_t order,
+					 bst_batch_visitor_t visit, void *context);
+
+/*
+ * Výpis uzlov v poradí order vo formáte bst_print_node do súboru out.
+ * Výstup sa skladá vo vyrovnávacej pamäti a zapisuje sa naraz.
+ */
+void bst_print_buffered(bst_node_t *tree, bst_order_t order, FILE *out);
+
+/*
+ * Nemenná kópia stromu uložená v poli v Eytzingerovom poradí.
+ *
+ * Kľúč na indexe i má ľavého potomka na indexe 2i a pravého na 2i + 1,
+ * index 0 sa nepoužíva. Kľúče a hodnoty sú v samostatných poliach, aby sa
+ * pri vyhľadávaní čítali iba kľúče. Položka mapped je nenulová, ak snímka
+ * leží v súbore namapovanom funkciou bst_snapshot_map.
+ */
+typedef struct bst_snapshot
+{
+	char *keys;
+	int *values;
+	int count;
+	size_t mapped;
+} bst_snapshot_t;
+
+/*
+ * Vytvorenie snímky zo stromu, pri chybe alokácie vráti false.
+ */
+bool bst_snapshot_build(bst_node_t *tree, bst_snapshot_t *snapshot);
+
+/*
+ * Vyhľadanie v snímke, výsledok je rovnaký ako pri bst_search nad stromom,
+ * z ktorého snímka vznikla.
+ */
+bool bst_snapshot_search(const bst_snapshot_t *snapshot, char key, int *value);
+
+/*
+ * Zápis snímky do súboru a jej namapovanie späť iba na čítanie. Súbor
+ * obsahuje verziu formátu a kontrolné súčty hlavičky a dát. bst_snapshot_map
+ * overí iba hlavičku a odmietne súbor inej verzie, celý súbor prejde až
+ * bst_snapshot_verify. Namapovaná snímka sa uvoľní funkciou
+ * bst_snapshot_dispose.
+ *
+ * Iba v režime BST_IMAGE.
+ */
+bool bst_snapshot_save(const bst_snapshot_t *snapshot, const char *path);
+bool bst_snapshot_map(const char *path, bst_snapshot_t *snapshot);
+bool bst_snapshot_verify(const bst_snapshot_t *snapshot);
+
+/*
+ * Uvoľnenie snímky.
+ */
+void bst_snapshot_dispose(bst_snapshot_t *snapshot);
+
+/*
+ * Vytvorenie vyváženého stromu z n kľúčov usporiadaných vzostupne a bez
+ * opakovania v čase O(n). Pôvodný obsah stromu sa zruší, pri chybe vráti
+ * false a strom zostane prázdny.
+ */
+bool bst_build_from_sorted(bst_node_t **tree, const char *keys,
+						   const int *values, int n);
+
+/*
+ * Vyváženie existujúceho stromu na mieste v čase O(n) bez alokácie.
+ */
+void bst_rebalance(bst_node_t **tree);
+
+/*
+ * Vytvorenie novej verzie stromu v čase O(1). Verzie zdieľajú uzly, zmeny
+ * jednej sa ostatných netýkajú a každú treba zrušiť funkciou bst_dispose.
+ *
+ * Počty odkazov sa menia atomicky. Verziu, ktorú vytvorí zapisujúce vlákno,
+ * preto môže iné vlákno čítať a zrušiť, kým zapisujúce vlákno pokračuje
+ * v bst_insert a bst_delete nad svojou verziou. Samotné bst_share sa musí
+ * volať v zapisujúcom vlákne alebo s ním synchronizovane. V režime BST_POOL
+ * sa so zápismi musí synchronizovať aj rušenie verzií, lebo zásobáreň
+ * stromu nemá zámok.
+ *
+ * Iba v režime BST_PERSISTENT.
+ */
+bst_node_t *bst_share(bst_node_t *tree);
+
+/*
+ * Poradové štatistiky nad veľkosťami podstromov v čase O(h): počet uzlov,
+ * počet kľúčov menších ako key, k-ty najmenší kľúč (od 0) a počet kľúčov
+ * z intervalu [low, high). bst_select vráti false, ak strom nemá viac ako
+ * k uzlov.
+ *
+ * Iba v režime BST_ORDER.
+ */
+int bst_size(bst_node_t *tree);
+int bst_rank(bst_node_t *tree, char key);
+bool bst_select(bst_node_t *tree, int k, char *key, int *value);
+int bst_count_range(bst_node_t *tree, char low, char high);
+
+/*
+ * Paralelný prechod stromom v threads vláknach, ktorý pre každý uzol zavolá
+ * visit. Poradie nie je určené a visit sa volá súčasne z viacerých vlákien.
+ *
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil.
+ *
+ * Každé volanie bst_visit_parallel aj bst_dispose_parallel spustí threads - 1
+ * nových vlákien a pred návratom na ne počká. Vlákna sa medzi volaniami
+ * nepoužívajú znova, takže pre malé stromy je bst_visit rýchlejší.
+ *
+ * Iba v režime BST_PARALLEL.
+ */
+bool bst_visit_parallel(bst_node_t *tree, int threads, bst_visitor_t visit,
+						void *context);
+
+/*
+ * Paralelné zrušenie stromu v threads vláknach.
+ *
+ * Iba v režime BST_PARALLEL.
+ */
+void bst_dispose_parallel(bst_node_t **tree, int threads);
+
+/*
+ * Inorder a preorder prechod bez zásobníku (Morrisov prechod), poradie
+ * spracovania uzlov je rovnaké ako pri bst_inorder a bst_preorder.
+ *
+ * Prechod počas behu dočasne mení pravé ukazovatele uzlov. V režimoch
+ * BST_PERSISTENT a BST_CONCURRENT, kde uzly môže súčasne čítať alebo rušiť
+ * iné vlákno, sa preto namiesto neho volá bst_inorder a bst_preorder
+ * so zásobníkom.
+ *
+ * Iba iteratívna varianta.
+ */
+void bst_inorder_morris(bst_node_t *tree);
+void bst_preorder_morris(bst_node_t *tree);
+
+/*
+ * Inicializácia a uvoľnenie zásobníku bst_stack_t.
+ *
+ * Iba iteratívna varianta.
+ */
+void bst_stack_init(bst_stack_t *stack);
+void bst_stack_dispose(bst_stack_t *stack);
+
+/*
+ * Prechody a zrušenie stromu s použitím zásobníku volajúceho, ktorý nemá
+ * pevnú kapacitu.
+ *
+ * Iba iteratívna varianta.
+ */
+void bst_preorder_stack(bst_node_t *tree, bst_stack_t *stack);
+void bst_inorder_stack(bst_node_t *tree, bst_stack_t *stack);
+void bst_postorder_stack(bst_node_t *tree, bst_stack_t *stack);
+void bst_dispose_stack(bst_node_t **tree, bst_stack_t *stack);
+
+/*
+ * Prechod stromom ako bst_visit so zásobníkom volajúceho.
+ *
+ * Iba iteratívna varianta.
+ */
+bool bst_visit_stack(bst_node_t *tree, bst_order_t order, bst_stack_t *stack,
+					 bst_visitor_t visit, void *context);
+
+/*
+ * Krokovanie inorder a postorder prechodu bez zásobníku s použitím
+ * ukazovateľov na rodiča. Funkcie *_first vrátia prvý uzol podstromu tree,
+ * ostatné susedný uzol alebo NULL, ak taký nie je.
+ *
+ * Iba iteratívna varianta v režime BST_PARENT.
+ */
+bst_node_t *bst_inorder_first(bst_node_t *tree);
+bst_node_t *bst_inorder_next(bst_node_t *node);
+bst_node_t *bst_inorder_prev(bst_node_t *node);
+bst_node_t *bst_postorder_first(bst_node_t *tree);
+bst_node_t *bst_postorder_next(bst_node_t *node);
+
+/*
+ * Kurzor nad usporiadanými kľúčmi stromu.
+ *
+ * Zásobník obsahuje cestu od koreňa k aktuálnemu uzlu na vrchole, prázdny
+ * zásobník znamená, že kurzor je za koncom. Príznak failed hovorí, že sa
+ * kurzor dostal za koniec pre chybu alokácie. Každá zmena stromu kurzor
+ * zneplatní.
+ */
+typedef struct bst_cursor
+{
+	bst_stack_t path;
+	bool failed;
+} bst_cursor_t;
+
+/*
+ * Inicializácia a uvoľnenie kurzoru.
+ *
+ * Iba iteratívna varianta.
+ */
+void bst_cursor_init(bst_cursor_t *cursor);
+void bst_cursor_dispose(bst_cursor_t *cursor);
+
+/*
+ * Nastavenie kurzoru na najmenší kľúč, najväčší kľúč alebo najmenší kľúč
+ * väčší alebo rovný key (lower bound) v čase O(h).
+ *
+ * Vrátia false, ak taký kľúč neexistuje alebo zlyhala alokácia, kurzor je
+ * potom za koncom. Iba iteratívna varianta.
+ */
+bool bst_cursor_first(bst_cursor_t *cursor, bst_node_t *tree);
+bool bst_cursor_last(bst_cursor_t *cursor, bst_node_t *tree);
+bool bst_cursor_seek(bst_cursor_t *cursor, bst_node_t *tree, char key);
+
+/*
+ * Posun kurzoru na nasledujúci alebo predchádzajúci kľúč.
+ *
+ * Vrátia false, ak taký kľúč neexistuje alebo zlyhala alokácia, kurzor je
+ * potom za koncom. Iba iteratívna varianta.
+ */
+bool bst_cursor_next(bst_cursor_t *cursor);
+bool bst_cursor_prev(bst_cursor_t *cursor);
+
+/*
+ * Aktuálny uzol kurzoru alebo NULL, ak je kurzor za koncom.
+ *
+ * Iba iteratívna varianta.
+ */
+bst_node_t *bst_cursor_node(const bst_cursor_t *cursor);
+
+/*
+ * Prechod kľúčov z intervalu [low, high) vzostupne, ktorý pre každý uzol
+ * zavolá visit, v čase O(h + k) pre k nájdených kľúčov.
+ *
+ * Vráti true, ak prechod prešiel celý interval, false ak ho visit ukončil
+ * alebo zlyhala alokácia. Iba iteratívna varianta.
+ */
+bool bst_visit_range(bst_node_t *tree, char low, char high,
+					 bst_visitor_t visit, void *context);
+
+#endif
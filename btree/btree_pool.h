@@ -0,0 +1,128 @@
+/*
+ * Zásobárne uzlov binárneho vyhľadávacieho stromu spoločné pre rekurzívnu
+ * aj iteratívnu variantu.
+ *
+ * Súbor vkladajú obe varianty po definícii svojich pomocných údajov
+ * uzlu bst_entry_t. Samostatne sa neprekladá.
+ */
+
+#ifndef IAL_BTREE_POOL_H
+#define IAL_BTREE_POOL_H
+
+/*
+ * Zásobárne uzlov (pool), zapínajú sa prekladom s -DBST_POOL.
+ *
+ * Každý strom má vlastnú zásobáreň, ktorá vzniká pri vložení do prázdneho
+ * stromu. Uzly sa berú zo súvislých blokov s rastúcou veľkosťou, zmazané uzly
+ * sa vracajú do zoznamu voľných uzlov a bst_dispose uvoľní celú zásobáreň
+ * naraz. bst_dispose sa v tomto režime musí volať nad celým stromom.
+ */
+#ifdef BST_POOL
+#ifndef BST_POOL_CHUNK
+#define BST_POOL_CHUNK 16
+#endif
+
+typedef struct bst_pool_chunk
+{
+	struct bst_pool_chunk *next;
+	int used;
+	int capacity;
+	bst_entry_t entries[];
+} bst_pool_chunk_t;
+
+typedef struct bst_pool
+{
+	bst_pool_chunk_t *chunks;
+	// Free nodes, linked through their left pointer
+	bst_node_t *free_nodes;
+	int live;
+} bst_pool_t;
+
+/*
+ * Pridanie nového bloku s kapacitou capacity uzlov do zásobárne.
+ */
+static bool bst_pool_grow(bst_pool_t *pool, int capacity)
+{
+	bst_pool_chunk_t *chunk = malloc(sizeof(bst_pool_chunk_t) +
+									 capacity * sizeof(bst_entry_t));
+	// Malloc fail
+	if (chunk == NULL)
+	{
+		return false;
+	}
+	chunk->next = pool->chunks;
+	chunk->used = 0;
+	chunk->capacity = capacity;
+	pool->chunks = chunk;
+	return true;
+}
+
+/*
+ * Vytvorenie zásobárne, ktorej prvý blok má miesto aspoň pre capacity uzlov.
+ */
+static bst_pool_t *bst_pool_new(int capacity)
+{
+	bst_pool_t *pool = malloc(sizeof(bst_pool_t));
+	// Malloc fail
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+	pool->chunks = NULL;
+	pool->free_nodes = NULL;
+	pool->live = 0;
+	if (!bst_pool_grow(pool, capacity > BST_POOL_CHUNK ? capacity
+													   : BST_POOL_CHUNK))
+	{
+		free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+/*
+ * Uvoľnenie zásobárne spolu so všetkými jej uzlami.
+ */
+static void bst_pool_release(bst_pool_t *pool)
+{
+	while (pool->chunks != NULL)
+	{
+		bst_pool_chunk_t *next = pool->chunks->next;
+		free(pool->chunks);
+		pool->chunks = next;
+	}
+	free(pool);
+}
+
+/*
+ * Alokácia miesta pre uzol zo zásobárne.
+ */
+static bst_entry_t *bst_pool_alloc(bst_pool_t *pool)
+{
+	bst_entry_t *entry;
+
+	// Reuse a previously deleted node first
+	if (pool->free_nodes != NULL)
+	{
+		entry = BST_ENTRY(pool->free_nodes);
+		pool->free_nodes = pool->free_nodes->left;
+	}
+	else
+	{
+		// Current chunk is full, start a twice as large one
+		if (pool->chunks->used == pool->chunks->capacity &&
+			!bst_pool_grow(pool, 2 * pool->chunks->capacity))
+		{
+			// Malloc fail
+			return NULL;
+		}
+		entry = &pool->chunks->entries[pool->chunks->used++];
+	}
+
+	entry->pool = pool;
+	pool->live++;
+	return entry;
+}
+#endif
+
+#endif
@@ -0,0 +1,1042 @@
+/*
+ * Časti binárneho vyhľadávacieho stromu spoločné pre rekurzívnu aj
+ * iteratívnu variantu.
+ *
+ * Sú tu rozšírenia, ktoré nezávisia od spôsobu prechodu stromom. Súbor
+ * vkladajú na svoj koniec súbory rec/btree.c a iter/btree.c, takže môže
+ * používať ich pomocné údaje uzlu a statické funkcie. Samostatne sa
+ * neprekladá.
+ */
+
+#ifndef IAL_BTREE_SHARED_H
+#define IAL_BTREE_SHARED_H
+
+#ifdef BST_PARALLEL
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef BST_IMAGE
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Zberač uzlov pre bst_visit_batch.
+ */
+typedef struct bst_batch
+{
+	bst_node_t *nodes[BST_VISIT_BATCH];
+	int count;
+	bst_batch_visitor_t visit;
+	void *context;
+} bst_batch_t;
+
+static bool bst_batch_add(bst_node_t *node, void *context)
+{
+	bst_batch_t *batch = context;
+
+	batch->nodes[batch->count++] = node;
+
+	// Batch is full, hand it over
+	if (batch->count == BST_VISIT_BATCH)
+	{
+		batch->count = 0;
+		return batch->visit(batch->nodes, BST_VISIT_BATCH, batch->context);
+	}
+	return true;
+}
+
+/*
+ * Prechod stromom, ktorý odovzdáva uzly po poliach BST_VISIT_BATCH.
+ */
+bool bst_visit_batch(bst_node_t *tree, bst_order_t order,
+					 bst_batch_visitor_t visit, void *context)
+{
+	bst_batch_t batch = {.count = 0, .visit = visit, .context = context};
+
+	if (!bst_visit(tree, order, bst_batch_add, &batch))
+	{
+		return false;
+	}
+
+	// Hand over the rest
+	if (batch.count > 0)
+	{
+		return visit(batch.nodes, batch.count, context);
+	}
+	return true;
+}
+
+/*
+ * Vyrovnávacia pamäť pre bst_print_buffered.
+ */
+#ifndef BST_PRINT_BUFFER
+#define BST_PRINT_BUFFER 16384
+#endif
+
+typedef struct bst_print_buffer
+{
+	char data[BST_PRINT_BUFFER];
+	size_t used;
+	FILE *out;
+} bst_print_buffer_t;
+
+static bool bst_print_add(bst_node_t *node, void *context)
+{
+	bst_print_buffer_t *buffer = context;
+
+	// Longest node is "[c,-2147483648]"
+	if (BST_PRINT_BUFFER - buffer->used < 32)
+	{
+		fwrite(buffer->data, 1, buffer->used, buffer->out);
+		buffer->used = 0;
+	}
+
+	// Same format as bst_print_node
+	buffer->used += snprintf(buffer->data + buffer->used,
+							 BST_PRINT_BUFFER - buffer->used, "[%c,%d]",
+							 node->key, node->value);
+	return true;
+}
+
+/*
+ * Výpis uzlov v poradí order, zapísaný jedným volaním fwrite.
+ */
+void bst_print_buffered(bst_node_t *tree, bst_order_t order, FILE *out)
+{
+	bst_print_buffer_t *buffer = malloc(sizeof(bst_print_buffer_t));
+	// Malloc fail
+	if (buffer == NULL)
+	{
+		return;
+	}
+	buffer->used = 0;
+	buffer->out = out;
+
+	bst_visit(tree, order, bst_print_add, buffer);
+	fwrite(buffer->data, 1, buffer->used, out);
+
+	free(buffer);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BST_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define BST_PREFETCH(address) ((void)(address))
+#endif
+
+/*
+ * Snímka stromu v Eytzingerovom poradí.
+ */
+#ifndef BST_SNAPSHOT_PREFETCH
+// Keys 6 levels down share one 64-byte line
+#define BST_SNAPSHOT_PREFETCH 64
+#endif
+
+typedef struct bst_snapshot_fill
+{
+	bst_snapshot_t *snapshot;
+	int index;
+} bst_snapshot_fill_t;
+
+// Store keys in sorted order, permuted afterwards
+static bool bst_snapshot_add(bst_node_t *node, void *context)
+{
+	bst_snapshot_fill_t *fill = context;
+
+	fill->snapshot->keys[fill->index] = node->key;
+	fill->snapshot->values[fill->index] = node->value;
+	fill->index++;
+	return true;
+}
+
+static bool bst_snapshot_count(bst_node_t *node, void *context)
+{
+	(void)node;
+	(*(int *)context)++;
+	return true;
+}
+
+/*
+ * Vytvorenie snímky stromu.
+ *
+ * Uzly sa najprv vyberú v poradí inorder a potom sa rozmiestnia tak, že
+ * inorder prechod implicitného stromu s indexmi 1..n dáva zoradené kľúče.
+ */
+bool bst_snapshot_build(bst_node_t *tree, bst_snapshot_t *snapshot)
+{
+	int count = 0;
+	bst_visit(tree, BST_INORDER, bst_snapshot_count, &count);
+
+	snapshot->count = count;
+	snapshot->mapped = 0;
+	snapshot->keys = malloc((count + 1) * sizeof(char));
+	snapshot->values = malloc((count + 1) * sizeof(int));
+	char *sorted_keys = malloc((count + 1) * sizeof(char));
+	int *sorted_values = malloc((count + 1) * sizeof(int));
+
+	// Malloc fail
+	if (snapshot->keys == NULL || snapshot->values == NULL ||
+		sorted_keys == NULL || sorted_values == NULL)
+	{
+		free(sorted_keys);
+		free(sorted_values);
+		bst_snapshot_dispose(snapshot);
+		return false;
+	}
+
+	// Collect sorted pairs into the snapshot, then move them aside
+	bst_snapshot_fill_t fill = {.snapshot = snapshot, .index = 0};
+	bst_visit(tree, BST_INORDER, bst_snapshot_add, &fill);
+	memcpy(sorted_keys, snapshot->keys, count * sizeof(char));
+	memcpy(sorted_values, snapshot->values, count * sizeof(int));
+
+	// Walk the implicit tree inorder, starting at its leftmost index
+	int index = 1;
+	while (2 * index <= count)
+	{
+		index *= 2;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		snapshot->keys[index] = sorted_keys[i];
+		snapshot->values[index] = sorted_values[i];
+
+		// Successor is the leftmost index of the right subtree
+		if (2 * index + 1 <= count)
+		{
+			index = 2 * index + 1;
+			while (2 * index <= count)
+			{
+				index *= 2;
+			}
+		}
+		// Otherwise climb while coming from a right child
+		else
+		{
+			while (index & 1)
+			{
+				index >>= 1;
+			}
+			index >>= 1;
+		}
+	}
+
+	// Unused slot 0 still held a sorted pair, saved images must not vary
+	snapshot->keys[0] = 0;
+	snapshot->values[0] = 0;
+
+	free(sorted_keys);
+	free(sorted_values);
+	return true;
+}
+
+/*
+ * Vyhľadanie v snímke bez vetvenia podľa porovnania kľúčov.
+ *
+ * Zostup vždy prejde celú výšku stromu a prednačítava kľúče niekoľko úrovní
+ * dopredu. Z konečného indexu sa odstránia kroky doprava od posledného
+ * kroku doľava, čím sa získa prvý kľúč nie menší ako key.
+ */
+bool bst_snapshot_search(const bst_snapshot_t *snapshot, char key, int *value)
+{
+	const char *keys = snapshot->keys;
+	int count = snapshot->count;
+	unsigned index = 1;
+
+	while (index <= (unsigned)count)
+	{
+		unsigned ahead = index * BST_SNAPSHOT_PREFETCH;
+		BST_PREFETCH(&keys[ahead <= (unsigned)count ? ahead : 0]);
+		index = 2 * index + (keys[index] < key);
+	}
+
+	// Undo the trailing right turns and the last left turn
+	while (index & 1)
+	{
+		index >>= 1;
+	}
+	index >>= 1;
+
+	if (index == 0 || keys[index] != key)
+	{
+		return false;
+	}
+
+	*value = snapshot->values[index];
+	return true;
+}
+
+/*
+ * Súbor so snímkou, zapína sa prekladom s -DBST_IMAGE.
+ *
+ * Snímka neobsahuje ukazovatele, preto sa do súboru zapíše tak, ako leží
+ * v pamäti: hlavička, pole kľúčov od offsetu BST_IMAGE_HEADER a za ním
+ * zarovnané pole hodnôt. Namapovaná snímka ukazuje priamo do súboru. Čísla
+ * sú v poradí bajtov stroja, ktorý súbor zapísal, a iný stroj ho odmietne.
+ */
+#ifdef BST_IMAGE
+#define BST_IMAGE_MAGIC 0x42534149u
+#define BST_IMAGE_VERSION 2u
+#define BST_IMAGE_BYTE_ORDER 0x01020304u
+
+typedef struct bst_image_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t count;
+	uint32_t size;
+	uint32_t values_offset;
+	uint32_t checksum;
+	uint32_t header_checksum;
+} bst_image_header_t;
+
+#define BST_IMAGE_HEADER sizeof(bst_image_header_t)
+
+// FNV-1a over size bytes of data
+static uint32_t bst_image_checksum(const unsigned char *data, size_t size)
+{
+	uint32_t result = 0x811c9dc5u;
+	for (size_t i = 0; i < size; i++)
+	{
+		result ^= data[i];
+		result *= 0x01000193u;
+	}
+	return result;
+}
+
+// The header checksum covers the header with its own field zeroed
+static uint32_t bst_image_header_checksum(bst_image_header_t header)
+{
+	header.header_checksum = 0;
+	return bst_image_checksum((const unsigned char *)&header, sizeof(header));
+}
+
+/*
+ * Zápis snímky do súboru path, pri chybe vráti false.
+ */
+bool bst_snapshot_save(const bst_snapshot_t *snapshot, const char *path)
+{
+	size_t count = snapshot->count;
+	size_t values_offset = (BST_IMAGE_HEADER + count + 1 + sizeof(int) - 1) /
+						   sizeof(int) * sizeof(int);
+	size_t size = values_offset + (count + 1) * sizeof(int);
+
+	unsigned char *image = calloc(size, 1);
+	// Malloc fail
+	if (image == NULL)
+	{
+		return false;
+	}
+
+	memcpy(image + BST_IMAGE_HEADER, snapshot->keys, count + 1);
+	memcpy(image + values_offset, snapshot->values, (count + 1) * sizeof(int));
+
+	bst_image_header_t header = {
+		.magic = BST_IMAGE_MAGIC,
+		.version = BST_IMAGE_VERSION,
+		.byte_order = BST_IMAGE_BYTE_ORDER,
+		.count = count,
+		.size = size,
+		.values_offset = values_offset,
+		.checksum = bst_image_checksum(image + BST_IMAGE_HEADER,
+									   size - BST_IMAGE_HEADER),
+	};
+	header.header_checksum = bst_image_header_checksum(header);
+	memcpy(image, &header, sizeof(header));
+
+	FILE *file = fopen(path, "wb");
+	bool written = file != NULL && fwrite(image, 1, size, file) == size;
+	if (file != NULL && fclose(file) != 0)
+	{
+		written = false;
+	}
+
+	free(image);
+	return written;
+}
+
+/*
+ * Namapovanie snímky zo súboru path iba na čítanie.
+ *
+ * Overí sa iba hlavička a jej kontrolný súčet, takže namapovanie nezávisí od
+ * veľkosti súboru. Cudzí súbor alebo súbor s poškodenou hlavičkou vráti false
+ * a snímka zostane nezmenená. Kľúče a hodnoty overí až bst_snapshot_verify.
+ */
+bool bst_snapshot_map(const char *path, bst_snapshot_t *snapshot)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)BST_IMAGE_HEADER ||
+		info.st_size > (off_t)UINT32_MAX)
+	{
+		close(fd);
+		return false;
+	}
+
+	size_t size = info.st_size;
+	unsigned char *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+	if (image == MAP_FAILED)
+	{
+		return false;
+	}
+
+	bst_image_header_t header;
+	memcpy(&header, image, sizeof(header));
+
+	size_t count = header.count;
+	if (header.magic != BST_IMAGE_MAGIC ||
+		header.version != BST_IMAGE_VERSION ||
+		header.byte_order != BST_IMAGE_BYTE_ORDER || header.size != size ||
+		header.values_offset % sizeof(int) != 0 ||
+		header.values_offset < BST_IMAGE_HEADER + count + 1 ||
+		header.values_offset + (count + 1) * sizeof(int) != size ||
+		header.header_checksum != bst_image_header_checksum(header))
+	{
+		munmap(image, size);
+		return false;
+	}
+
+	// Search only reads through these, the mapping is never written
+	snapshot->keys = (char *)image + BST_IMAGE_HEADER;
+	snapshot->values = (int *)(image + header.values_offset);
+	snapshot->count = count;
+	snapshot->mapped = size;
+	return true;
+}
+
+/*
+ * Overenie kontrolného súčtu kľúčov a hodnôt namapovanej snímky.
+ *
+ * Prejde celý súbor, preto sa volá iba pri súboroch z nedôveryhodného zdroja.
+ * Snímka, ktorá nie je namapovaná, vráti false.
+ */
+bool bst_snapshot_verify(const bst_snapshot_t *snapshot)
+{
+	if (snapshot->mapped == 0)
+	{
+		return false;
+	}
+
+	const unsigned char *image =
+		(const unsigned char *)snapshot->keys - BST_IMAGE_HEADER;
+	bst_image_header_t header;
+	memcpy(&header, image, sizeof(header));
+	return header.checksum == bst_image_checksum(image + BST_IMAGE_HEADER,
+												 snapshot->mapped -
+													 BST_IMAGE_HEADER);
+}
+#endif
+
+/*
+ * Uvoľnenie snímky.
+ */
+void bst_snapshot_dispose(bst_snapshot_t *snapshot)
+{
+#ifdef BST_IMAGE
+	if (snapshot->mapped > 0)
+	{
+		munmap(snapshot->keys - BST_IMAGE_HEADER, snapshot->mapped);
+		snapshot->keys = NULL;
+		snapshot->values = NULL;
+		snapshot->count = 0;
+		snapshot->mapped = 0;
+		return;
+	}
+#endif
+	free(snapshot->keys);
+	free(snapshot->values);
+	snapshot->keys = NULL;
+	snapshot->values = NULL;
+	snapshot->count = 0;
+}
+
+/*
+ * Vytvorenie stromu z n kľúčov usporiadaných vzostupne a bez opakovania
+ * a im zodpovedajúcich hodnôt v čase O(n).
+ *
+ * Pôvodný obsah stromu sa zruší. Výsledný strom je dokonale vyvážený,
+ * v režime BST_POOL ležia všetky jeho uzly v jednom bloku. Ak kľúče nie sú
+ * usporiadané alebo zlyhá alokácia, vráti false a strom zostane prázdny.
+ */
+bool bst_build_from_sorted(bst_node_t **tree, const char *keys,
+						   const int *values, int n)
+{
+	bst_dispose(tree);
+
+	// Malloc fail while creating the tree header
+	if (!bst_header_attach(tree))
+	{
+		return false;
+	}
+	tree = bst_root_link(tree);
+
+	// Keys must be strictly increasing
+	for (int i = 1; i < n; i++)
+	{
+		if (keys[i - 1] >= keys[i])
+		{
+			return false;
+		}
+	}
+
+	if (!bst_build_range(tree, keys, values, n))
+	{
+		bst_dispose(tree);
+		return false;
+	}
+	return true;
+}
+
+#ifdef BST_REPAIR_PATHS
+static bool bst_repair_visit(bst_node_t *node, void *context)
+{
+	(void)context;
+#ifdef BST_ORDER
+	bst_update_size(node);
+#endif
+#ifdef BST_BALANCED
+	bst_update_height(node);
+#endif
+	return true;
+}
+#endif
+
+#ifdef BST_PARENT
+static bool bst_parent_visit(bst_node_t *node, void *context)
+{
+	(void)context;
+	bst_set_parent(node->left, node);
+	bst_set_parent(node->right, node);
+	return true;
+}
+#endif
+
+/*
+ * Stlačenie pravej vetvy stromu: prvých count uzlov na párnych pozíciách
+ * vetvy sa rotáciou doľava stane ľavým potomkom svojho nasledovníka.
+ * Pri chybe alokácie vráti false, strom zostane platný.
+ */
+static bool bst_vine_compress(bst_node_t **tree, int count)
+{
+	bst_node_t **link = tree;
+
+	for (int i = 0; i < count; i++)
+	{
+		// Malloc fail while copying nodes shared with another version
+		if (!bst_unshare(link) || !bst_unshare(&(*link)->right))
+		{
+			return false;
+		}
+
+		bst_node_t *node = *link;
+		bst_node_t *right = node->right;
+		node->right = right->left;
+		right->left = node;
+		*link = right;
+		link = &right->right;
+	}
+	return true;
+}
+
+/*
+ * Vyváženie existujúceho stromu na mieste v čase O(n) bez alokácie
+ * (algoritmus Day-Stout-Warren).
+ *
+ * Strom sa rotáciami doprava narovná do pravej vetvy a tá sa postupným
+ * stláčaním zloží späť do stromu, ktorého listy ležia najviac v dvoch
+ * posledných úrovniach. Uzly ani ich adresy sa nemenia.
+ */
+void bst_rebalance(bst_node_t **tree)
+{
+	tree = bst_root_link(tree);
+	bst_node_t **link = tree;
+	int count = 0;
+	bool copied = true;
+
+	// Flatten the tree into a right vine
+	while (*link != NULL)
+	{
+		// Malloc fail while copying nodes shared with another version
+		if (!bst_unshare(link) || !bst_unshare(&(*link)->left))
+		{
+			copied = false;
+			break;
+		}
+
+		bst_node_t *node = *link;
+		if (node->left != NULL)
+		{
+			bst_node_t *left = node->left;
+			node->left = left->right;
+			left->right = node;
+			*link = left;
+		}
+		else
+		{
+			count++;
+			link = &node->right;
+		}
+	}
+
+	// Nodes beyond the largest perfect tree become leaves of the last level
+	int perfect = 1;
+	while (2 * perfect + 1 <= count)
+	{
+		perfect = 2 * perfect + 1;
+	}
+	copied = copied && bst_vine_compress(tree, count - perfect);
+
+	// Fold the rest of the vine level by level
+	for (int size = perfect / 2; copied && size > 0; size /= 2)
+	{
+		copied = bst_vine_compress(tree, size);
+	}
+
+#ifdef BST_REPAIR_PATHS
+	// Rotations above left the stored sizes and heights stale
+	bst_visit(*tree, BST_POSTORDER, bst_repair_visit, NULL);
+#endif
+#ifdef BST_PARENT
+	// Rotations above moved nodes between parents
+	bst_set_parent(*tree, NULL);
+	bst_visit(*tree, BST_PREORDER, bst_parent_visit, NULL);
+#endif
+}
+
+/*
+ * Paralelný prechod a zrušenie stromu, zapínajú sa prekladom s
+ * -DBST_PARALLEL.
+ *
+ * Každé vlákno má vlastný rad podstromov, z ktorého berie naposledy vložené
+ * podstromy. Keď je jeho rad prázdny, kradne najstaršie podstromy z radov
+ * ostatných vlákien, takže sa práca rozloží aj pri nevyváženom strome.
+ * Plný rad sa zdvojnásobí, a ak sa to nepodarí, vlákno podstrom spracuje
+ * samo.
+ */
+#ifdef BST_PARALLEL
+#ifndef BST_MAX_THREADS
+#define BST_MAX_THREADS 64
+#endif
+
+// Queue entries stored directly in the deque before it grows
+#ifndef BST_DEQUE_INLINE
+#define BST_DEQUE_INLINE 64
+#endif
+
+typedef struct bst_deque
+{
+	pthread_mutex_t lock;
+	bst_node_t **items;
+	int capacity;
+	// Thieves take from head, the owner pushes and pops at tail
+	int head;
+	int tail;
+	bst_node_t *inline_items[BST_DEQUE_INLINE];
+} bst_deque_t;
+
+typedef struct bst_parallel
+{
+	bst_visitor_t visit;
+	void *context;
+	bool dispose;
+	bool stop;
+	// Subtrees queued but not processed yet
+	int pending;
+	int threads;
+	bst_deque_t deques[];
+} bst_parallel_t;
+
+typedef struct bst_worker
+{
+	bst_parallel_t *parallel;
+	int index;
+} bst_worker_t;
+
+/*
+ * Uvoľnenie miesta na konci plného radu, pri chybe alokácie vráti false.
+ */
+static bool bst_deque_grow(bst_deque_t *deque)
+{
+	// Stolen entries left room at the front
+	if (deque->head > 0)
+	{
+		memmove(deque->items, deque->items + deque->head,
+				(deque->tail - deque->head) * sizeof(bst_node_t *));
+		deque->tail -= deque->head;
+		deque->head = 0;
+		return true;
+	}
+
+	int capacity = deque->capacity * 2;
+	bst_node_t **items = malloc(capacity * sizeof(bst_node_t *));
+	// Malloc fail
+	if (items == NULL)
+	{
+		return false;
+	}
+	memcpy(items, deque->items, deque->tail * sizeof(bst_node_t *));
+	if (deque->items != deque->inline_items)
+	{
+		free(deque->items);
+	}
+	deque->items = items;
+	deque->capacity = capacity;
+	return true;
+}
+
+/*
+ * Vloženie podstromu do radu, false ak je rad plný a nedá sa zväčšiť.
+ */
+static bool bst_deque_push(bst_parallel_t *parallel, bst_deque_t *deque,
+						   bst_node_t *node)
+{
+	pthread_mutex_lock(&deque->lock);
+	bool pushed = deque->tail < deque->capacity || bst_deque_grow(deque);
+	if (pushed)
+	{
+		__atomic_add_fetch(&parallel->pending, 1, __ATOMIC_ACQ_REL);
+		deque->items[deque->tail++] = node;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return pushed;
+}
+
+static bst_node_t *bst_deque_take(bst_deque_t *deque, bool steal)
+{
+	bst_node_t *node = NULL;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->head < deque->tail)
+	{
+		node = steal ? deque->items[deque->head++] : deque->items[--deque->tail];
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return node;
+}
+
+/*
+ * Spracovanie podstromu priamo vo vlákne, keď sa nevojde do radu.
+ */
+static void bst_parallel_inline(bst_parallel_t *parallel, bst_node_t *tree)
+{
+	if (parallel->dispose)
+	{
+		bst_dispose(&tree);
+	}
+	else if (!bst_visit(tree, BST_PREORDER, parallel->visit, parallel->context))
+	{
+		__atomic_store_n(&parallel->stop, true, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * Pracovné vlákno, ktoré spracúva podstromy, kým nie je strom prejdený.
+ */
+static void *bst_parallel_worker(void *argument)
+{
+	bst_worker_t *worker = argument;
+	bst_parallel_t *parallel = worker->parallel;
+	bst_deque_t *own = &parallel->deques[worker->index];
+
+	while (!__atomic_load_n(&parallel->stop, __ATOMIC_ACQUIRE))
+	{
+		bst_node_t *node = bst_deque_take(own, false);
+
+		// Own queue is empty, steal from the others
+		for (int i = 1; node == NULL && i < parallel->threads; i++)
+		{
+			int victim = (worker->index + i) % parallel->threads;
+			node = bst_deque_take(&parallel->deques[victim], true);
+		}
+
+		if (node == NULL)
+		{
+			// Nothing queued and nothing in progress, the tree is done
+			if (__atomic_load_n(&parallel->pending, __ATOMIC_ACQUIRE) == 0)
+			{
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		// A node still used by another version keeps its subtree
+		if (parallel->dispose && !bst_node_unref(node))
+		{
+			__atomic_sub_fetch(&parallel->pending, 1, __ATOMIC_ACQ_REL);
+			continue;
+		}
+
+		// Children are queued before the node counts as processed
+		bst_node_t *left = node->left;
+		bst_node_t *right = node->right;
+		if (right != NULL && !bst_deque_push(parallel, own, right))
+		{
+			bst_parallel_inline(parallel, right);
+		}
+		if (left != NULL && !bst_deque_push(parallel, own, left))
+		{
+			bst_parallel_inline(parallel, left);
+		}
+
+		if (parallel->dispose)
+		{
+			bst_node_free(node);
+		}
+		else if (!parallel->visit(node, parallel->context))
+		{
+			__atomic_store_n(&parallel->stop, true, __ATOMIC_RELEASE);
+		}
+		__atomic_sub_fetch(&parallel->pending, 1, __ATOMIC_ACQ_REL);
+	}
+	return NULL;
+}
+
+/*
+ * Spracovanie stromu v threads vláknach, volajúce vlákno je jedným z nich.
+ *
+ * Do finished zapíše, či sa prešiel celý strom. Pri chybe alokácie vráti
+ * false a strom sa nespracuje vôbec.
+ */
+static bool bst_parallel_run(bst_node_t *tree, int threads,
+							 bst_visitor_t visit, void *context, bool dispose,
+							 bool *finished)
+{
+	pthread_t ids[BST_MAX_THREADS];
+	bst_worker_t workers[BST_MAX_THREADS];
+
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+	if (threads > BST_MAX_THREADS)
+	{
+		threads = BST_MAX_THREADS;
+	}
+
+	bst_parallel_t *parallel = malloc(sizeof(bst_parallel_t) +
+									  threads * sizeof(bst_deque_t));
+	// Malloc fail
+	if (parallel == NULL)
+	{
+		return false;
+	}
+	parallel->visit = visit;
+	parallel->context = context;
+	parallel->dispose = dispose;
+	parallel->stop = false;
+	parallel->pending = 0;
+	parallel->threads = threads;
+	for (int i = 0; i < threads; i++)
+	{
+		bst_deque_t *deque = &parallel->deques[i];
+		pthread_mutex_init(&deque->lock, NULL);
+		deque->items = deque->inline_items;
+		deque->capacity = BST_DEQUE_INLINE;
+		deque->head = 0;
+		deque->tail = 0;
+	}
+	// An empty deque always has room
+	bst_deque_push(parallel, &parallel->deques[0], tree);
+
+	// Threads that fail to start leave their share to the others
+	int started = 1;
+	for (int i = 1; i < threads; i++)
+	{
+		workers[started].parallel = parallel;
+		workers[started].index = i;
+		if (pthread_create(&ids[started], NULL, bst_parallel_worker,
+						   &workers[started]) == 0)
+		{
+			started++;
+		}
+	}
+	workers[0].parallel = parallel;
+	workers[0].index = 0;
+	bst_parallel_worker(&workers[0]);
+
+	for (int i = 1; i < started; i++)
+	{
+		pthread_join(ids[i], NULL);
+	}
+
+	*finished = !parallel->stop;
+	for (int i = 0; i < threads; i++)
+	{
+		pthread_mutex_destroy(&parallel->deques[i].lock);
+		if (parallel->deques[i].items != parallel->deques[i].inline_items)
+		{
+			free(parallel->deques[i].items);
+		}
+	}
+	free(parallel);
+	return true;
+}
+
+/*
+ * Paralelný prechod stromom v threads vláknach, ktorý pre každý uzol zavolá
+ * visit. Poradie nie je určené a visit sa volá súčasne z viacerých vlákien.
+ *
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil.
+ */
+bool bst_visit_parallel(bst_node_t *tree, int threads, bst_visitor_t visit,
+						void *context)
+{
+	tree = bst_root(tree);
+	if (tree == NULL)
+	{
+		return true;
+	}
+
+	bool finished;
+	// Malloc fail, fall back to a single thread
+	if (!bst_parallel_run(tree, threads, visit, context, false, &finished))
+	{
+		return bst_visit(tree, BST_PREORDER, visit, context);
+	}
+	return finished;
+}
+
+/*
+ * Paralelné zrušenie stromu v threads vláknach.
+ */
+void bst_dispose_parallel(bst_node_t **tree, int threads)
+{
+	bst_header_dispose(tree);
+
+	// Empty and pooled trees need no threads
+	if (*tree == NULL || bst_dispose_all(tree))
+	{
+		return;
+	}
+
+#if defined(BST_POOL) && defined(BST_PERSISTENT)
+	// Pool free lists are not thread-safe
+	bst_dispose(tree);
+	return;
+#endif
+
+	bool finished;
+	// Malloc fail, fall back to a single thread
+	if (!bst_parallel_run(*tree, threads, NULL, NULL, true, &finished))
+	{
+		bst_dispose(tree);
+	}
+	*tree = NULL;
+}
+#endif
+
+#ifdef BST_PERSISTENT
+/*
+ * Vytvorenie novej verzie stromu v čase O(1).
+ *
+ * Vrátený strom zdieľa uzly so stromom tree, zmeny jedného z nich sa
+ * druhého netýkajú. Každú verziu treba zrušiť funkciou bst_dispose.
+ */
+bst_node_t *bst_share(bst_node_t *tree)
+{
+	if (tree != NULL)
+	{
+		bst_node_ref(tree);
+	}
+	return tree;
+}
+#endif
+
+#ifdef BST_ORDER
+/*
+ * Počet uzlov stromu v čase O(1).
+ */
+int bst_size(bst_node_t *tree)
+{
+	return bst_subtree_size(bst_root(tree));
+}
+
+/*
+ * Počet kľúčov stromu menších ako key.
+ */
+int bst_rank(bst_node_t *tree, char key)
+{
+	int rank = 0;
+
+	tree = bst_root(tree);
+	while (tree != NULL)
+	{
+		// The node and its whole left subtree are smaller
+		if (tree->key < key)
+		{
+			rank += bst_subtree_size(tree->left) + 1;
+			tree = tree->right;
+		}
+		else
+		{
+			tree = tree->left;
+		}
+	}
+	return rank;
+}
+
+/*
+ * Vyhľadanie k-teho najmenšieho kľúča (od 0).
+ *
+ * Ak strom nemá viac ako k uzlov, vráti false a key ani value nemení.
+ */
+bool bst_select(bst_node_t *tree, int k, char *key, int *value)
+{
+	if (k < 0)
+	{
+		return false;
+	}
+
+	tree = bst_root(tree);
+	while (tree != NULL)
+	{
+		int left = bst_subtree_size(tree->left);
+
+		if (k == left)
+		{
+			*key = tree->key;
+			*value = tree->value;
+			return true;
+		}
+
+		// Skip the left subtree and the node itself
+		if (k > left)
+		{
+			k -= left + 1;
+			tree = tree->right;
+		}
+		else
+		{
+			tree = tree->left;
+		}
+	}
+	return false;
+}
+
+/*
+ * Počet kľúčov stromu z intervalu [low, high).
+ */
+int bst_count_range(bst_node_t *tree, char low, char high)
+{
+	if (low >= high)
+	{
+		return 0;
+	}
+	return bst_rank(tree, high) - bst_rank(tree, low);
+}
+#endif
+
+#endif
@@ -7,9 +7,846 @@
  */
 
 #include "../btree.h"
-#include "stack.h"
+#include "../btree_ext.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef BST_CONCURRENT
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#endif
+
+/*
+ * Pomocné údaje uzlu.
+ *
+ * Typ bst_node_t je daný hlavičkovým súborom, preto sa údaje, ktoré
+ * potrebujú jednotlivé režimy, ukladajú pred uzol a uzly stromu sa v týchto
+ * režimoch alokujú výhradne ako bst_entry_t.
+ */
+#if defined(BST_BALANCED) || defined(BST_POOL) || defined(BST_CONCURRENT) || \
+	defined(BST_PERSISTENT) || defined(BST_PARENT) || defined(BST_ORDER)
+#define BST_ENTRY_NODES
+
+typedef struct bst_entry
+{
+#ifdef BST_POOL
+	struct bst_pool *pool;
+#endif
+#ifdef BST_BALANCED
+	int height;
+#endif
+#ifdef BST_ORDER
+	// Number of nodes in the subtree rooted here
+	int size;
+#endif
+#ifdef BST_PERSISTENT
+	// Number of links and tree versions pointing to the node
+	int refs;
+#endif
+#ifdef BST_PARENT
+	// NULL for the root
+	bst_node_t *parent;
+#endif
+#ifdef BST_CONCURRENT
+	// Odd while the node is being changed, stays odd once it is removed
+	unsigned version;
+	struct bst_entry *retired;
+	// Set only for the tree header, which holds no key
+	bool header;
+#endif
+	bst_node_t node;
+} bst_entry_t;
+
+#define BST_ENTRY(node_ptr) \
+	((bst_entry_t *)((char *)(node_ptr) - offsetof(bst_entry_t, node)))
+#endif
+
+/*
+ * Súbežný režim, zapína sa prekladom s -DBST_CONCURRENT.
+ *
+ * Každý uzol má verziu, ktorú zápis zvýši na nepárnu pred zmenou uzlu a na
+ * párnu po nej (uzamknutie uzlu). Rotácia uzamkne aj uzol, ktorému patrí
+ * otáčaný ukazovateľ. Odstránený uzol zostane uzamknutý. bst_search
+ * nepoužíva zámky, zapamätá si verzie uzlov na ceste a výsledok prijme, iba
+ * ak sa žiadny z nich medzitým nezmenil, inak hľadanie zopakuje od hlavičky
+ * stromu (pozri bst_root). Odstránené uzly sa uvoľňujú až po uplynutí dvoch
+ * epoch, keď ich už žiadny čitateľ nemôže držať (epoch-based reclamation).
+ *
+ * Zápisy sú zoradené hrubým zámkom: bst_insert a bst_delete nad jedným
+ * stromom sa striedajú pod jedným z BST_STRIPES zámkov vybraným podľa adresy
+ * hlavičky stromu, súbežne s nimi bežia iba čitatelia.
+ *
+ * Čitateľ musí ukazovateľ na strom odovzdávaný bst_search načítať atomicky.
+ * Ostatné funkcie, ktoré strom menia, vyžadujú výlučný prístup k stromu.
+ */
+#ifdef BST_CONCURRENT
+#ifdef BST_POOL
+#error "BST_CONCURRENT cannot be combined with BST_POOL"
+#endif
+
+#define BST_LOAD(location) __atomic_load_n(&(location), __ATOMIC_ACQUIRE)
+#define BST_PUBLISH(location, value) \
+	__atomic_store_n(&(location), (value), __ATOMIC_RELEASE)
+
+static void bst_node_lock(bst_node_t *node)
+{
+	// Root link of a tree without a header has no owner
+	if (node == NULL)
+	{
+		return;
+	}
+	bst_entry_t *entry = BST_ENTRY(node);
+	__atomic_store_n(&entry->version, entry->version + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void bst_node_unlock(bst_node_t *node)
+{
+	if (node == NULL)
+	{
+		return;
+	}
+	bst_entry_t *entry = BST_ENTRY(node);
+	__atomic_store_n(&entry->version, entry->version + 1, __ATOMIC_RELEASE);
+}
+#else
+#define BST_LOAD(location) (location)
+#define BST_PUBLISH(location, value) ((location) = (value))
+
+static inline void bst_node_lock(bst_node_t *node)
+{
+	(void)node;
+}
+
+static inline void bst_node_unlock(bst_node_t *node)
+{
+	(void)node;
+}
+#endif
+
+/*
+ * Režim trvalých verzií, zapína sa prekladom s -DBST_PERSISTENT.
+ *
+ * Funkcia bst_share vytvorí novú verziu stromu v čase O(1). Verzie zdieľajú
+ * uzly a každý uzol si pamätá počet odkazov naň. bst_insert, bst_delete
+ * a vyvažovanie pred zmenou zdieľaného uzlu nahradia uzol jeho kópiou, takže
+ * sa skopírujú iba uzly na ceste od koreňa a ostatné verzie sa nezmenia.
+ * bst_dispose uvoľní iba uzly, na ktoré už neodkazuje iná verzia. Počty
+ * odkazov sa menia atomicky, aby verzie mohli rušiť aj iné vlákna.
+ */
+#if defined(BST_PERSISTENT) && defined(BST_CONCURRENT)
+#error "BST_PERSISTENT cannot be combined with BST_CONCURRENT"
+#endif
+static bool bst_unshare(bst_node_t **link);
+
+/*
+ * Režim s ukazovateľom na rodiča, zapína sa prekladom s -DBST_PARENT.
+ *
+ * Každý uzol si pamätá svojho rodiča, takže krok na nasledujúci uzol pri
+ * inorder a postorder prechode nepotrebuje zásobník.
+ */
+#if defined(BST_PARENT) && defined(BST_PERSISTENT)
+#error "BST_PARENT cannot be combined with BST_PERSISTENT"
+#endif
+
+static void bst_set_parent(bst_node_t *node, bst_node_t *parent)
+{
+#ifdef BST_PARENT
+	if (node != NULL)
+	{
+		BST_ENTRY(node)->parent = parent;
+	}
+#else
+	(void)node;
+	(void)parent;
+#endif
+}
+
+static bst_node_t *bst_parent(bst_node_t *node)
+{
+#ifdef BST_PARENT
+	return BST_ENTRY(node)->parent;
+#else
+	(void)node;
+	return NULL;
+#endif
+}
+
+/*
+ * Poradové štatistiky, zapínajú sa prekladom s -DBST_ORDER.
+ *
+ * Každý uzol si pamätá veľkosť svojho podstromu, ktorú zápisy obnovujú na
+ * ceste od zmeneného miesta ku koreňu. Na nej stoja bst_rank, bst_select
+ * a bst_count_range s časom O(h).
+ */
+#ifdef BST_ORDER
+static int bst_subtree_size(bst_node_t *tree)
+{
+	return tree != NULL ? BST_ENTRY(tree)->size : 0;
+}
+
+static void bst_update_size(bst_node_t *tree)
+{
+	BST_ENTRY(tree)->size =
+		bst_subtree_size(tree->left) + bst_subtree_size(tree->right) + 1;
+}
+#endif
+
+// Writers repair node data on the way back up in these modes
+#if defined(BST_BALANCED) || defined(BST_ORDER)
+#define BST_REPAIR_PATHS
+
+// Keys are chars, so a tree has at most 256 nodes and no longer paths
+#define BST_MAX_HEIGHT 257
+#endif
+
+/*
+ * Vyvážený režim (AVL), zapína sa prekladom s -DBST_BALANCED.
+ *
+ * Rozhranie bst_* sa nemení, strom sa vyvažuje pri vkladaní aj mazaní.
+ */
+#ifdef BST_BALANCED
+
+static int bst_height(bst_node_t *tree)
+{
+	return tree != NULL ? BST_ENTRY(tree)->height : 0;
+}
+
+static void bst_update_height(bst_node_t *tree)
+{
+	int left = bst_height(tree->left);
+	int right = bst_height(tree->right);
+	BST_ENTRY(tree)->height = (left > right ? left : right) + 1;
+}
+
+// Left child becomes the root of the subtree, owner holds the link tree
+static void bst_rotate_right(bst_node_t *owner, bst_node_t **tree)
+{
+	// Malloc fail while copying nodes shared with another version
+	if (!bst_unshare(tree) || !bst_unshare(&(*tree)->left))
+	{
+		return;
+	}
+
+	bst_node_t *node = *tree;
+	bst_node_t *left = node->left;
+	bst_node_lock(owner);
+	bst_node_lock(node);
+	bst_node_lock(left);
+	BST_PUBLISH(node->left, left->right);
+	BST_PUBLISH(left->right, node);
+	bst_set_parent(left, bst_parent(node));
+	bst_set_parent(node->left, node);
+	bst_set_parent(node, left);
+	bst_update_height(node);
+	bst_update_height(left);
+#ifdef BST_ORDER
+	bst_update_size(node);
+	bst_update_size(left);
+#endif
+	BST_PUBLISH(*tree, left);
+	bst_node_unlock(left);
+	bst_node_unlock(node);
+	bst_node_unlock(owner);
+}
+
+// Right child becomes the root of the subtree, owner holds the link tree
+static void bst_rotate_left(bst_node_t *owner, bst_node_t **tree)
+{
+	// Malloc fail while copying nodes shared with another version
+	if (!bst_unshare(tree) || !bst_unshare(&(*tree)->right))
+	{
+		return;
+	}
+
+	bst_node_t *node = *tree;
+	bst_node_t *right = node->right;
+	bst_node_lock(owner);
+	bst_node_lock(node);
+	bst_node_lock(right);
+	BST_PUBLISH(node->right, right->left);
+	BST_PUBLISH(right->left, node);
+	bst_set_parent(right, bst_parent(node));
+	bst_set_parent(node->right, node);
+	bst_set_parent(node, right);
+	bst_update_height(node);
+	bst_update_height(right);
+#ifdef BST_ORDER
+	bst_update_size(node);
+	bst_update_size(right);
+#endif
+	BST_PUBLISH(*tree, right);
+	bst_node_unlock(right);
+	bst_node_unlock(node);
+	bst_node_unlock(owner);
+}
+
+/*
+ * Obnovenie výšky a vyváženosti uzlu, ktorého podstromy sú už vyvážené.
+ */
+static void bst_balance(bst_node_t *owner, bst_node_t **tree)
+{
+	if (*tree == NULL)
+	{
+		return;
+	}
+
+	int balance = bst_height((*tree)->left) - bst_height((*tree)->right);
+
+	// Left subtree is too high
+	if (balance > 1)
+	{
+		if (bst_height((*tree)->left->left) < bst_height((*tree)->left->right))
+		{
+			bst_rotate_left(*tree, &(*tree)->left);
+		}
+		bst_rotate_right(owner, tree);
+	}
+	// Right subtree is too high
+	else if (balance < -1)
+	{
+		if (bst_height((*tree)->right->right) < bst_height((*tree)->right->left))
+		{
+			bst_rotate_right(*tree, &(*tree)->right);
+		}
+		bst_rotate_left(owner, tree);
+	}
+	else
+	{
+		bst_update_height(*tree);
+	}
+}
+#endif
+
+#ifdef BST_REPAIR_PATHS
+/*
+ * Obnovenie veľkosti podstromu, výšky a vyváženosti uzlu po zmene jeho
+ * podstromov. owner je uzol, ktorému patrí ukazovateľ tree, alebo NULL.
+ */
+static void bst_repair(bst_node_t *owner, bst_node_t **tree)
+{
+	if (*tree == NULL)
+	{
+		return;
+	}
+#ifdef BST_ORDER
+	bst_update_size(*tree);
+#endif
+#ifdef BST_BALANCED
+	bst_balance(owner, tree);
+#else
+	(void)owner;
+#endif
+}
+#endif
+
+// Node pools, shared by both variants
+#include "../btree_pool.h"
+
+/*
+ * Alokácia nového listového uzlu.
+ *
+ * Parameter neighbour je uzol stromu, do ktorého sa nový uzol vkladá, alebo
+ * NULL, ak je strom prázdny. V režime BST_POOL sa nový uzol berie z jeho
+ * zásobárne a prázdny strom dostane novú zásobáreň s miestom pre count uzlov.
+ * V režime BST_PARENT sa neighbour stane rodičom nového uzlu.
+ */
+static bst_node_t *bst_node_new_sized(bst_node_t *neighbour, int count,
+									  char key, int value)
+{
+	bst_node_t *node;
+
+#ifdef BST_ENTRY_NODES
+	bst_entry_t *entry;
+#ifdef BST_POOL
+	// Empty tree gets its own pool
+	bst_pool_t *pool = neighbour != NULL ? BST_ENTRY(neighbour)->pool
+										 : bst_pool_new(count);
+	// Malloc fail
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+	entry = bst_pool_alloc(pool);
+	// Malloc fail, drop the pool if it was just created
+	if (entry == NULL)
+	{
+		if (pool->live == 0)
+		{
+			bst_pool_release(pool);
+		}
+		return NULL;
+	}
+#else
+	(void)neighbour;
+	(void)count;
+	entry = malloc(sizeof(bst_entry_t));
+	// Malloc fail
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+#endif
+#ifdef BST_BALANCED
+	entry->height = 1;
+#endif
+#ifdef BST_ORDER
+	entry->size = 1;
+#endif
+#ifdef BST_PERSISTENT
+	entry->refs = 1;
+#endif
+#ifdef BST_PARENT
+	entry->parent = neighbour;
+#endif
+#ifdef BST_CONCURRENT
+	entry->version = 0;
+	entry->header = false;
+#endif
+	node = &entry->node;
+#else
+	(void)neighbour;
+	(void)count;
+	node = malloc(sizeof(bst_node_t));
+	// Malloc fail
+	if (node == NULL)
+	{
+		return NULL;
+	}
+#endif
+	node->key = key;
+	node->value = value;
+	node->left = NULL;
+	node->right = NULL;
+	return node;
+}
+
+static bst_node_t *bst_node_new(bst_node_t *neighbour, char key, int value)
+{
+	return bst_node_new_sized(neighbour, 0, key, value);
+}
+
+/*
+ * Uvoľnenie uzlu alokovaného pomocou bst_node_new.
+ */
+static void bst_node_free(bst_node_t *node)
+{
+#ifdef BST_POOL
+	bst_pool_t *pool = BST_ENTRY(node)->pool;
+
+	// Return the node to the free list, the last node takes the pool along
+	node->left = pool->free_nodes;
+	pool->free_nodes = node;
+	if (--pool->live == 0)
+	{
+		bst_pool_release(pool);
+	}
+#elif defined(BST_ENTRY_NODES)
+	free(BST_ENTRY(node));
+#else
+	free(node);
+#endif
+}
+
+#ifdef BST_PERSISTENT
+/*
+ * Pridanie odkazu na uzol.
+ */
+static void bst_node_ref(bst_node_t *node)
+{
+	__atomic_fetch_add(&BST_ENTRY(node)->refs, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+/*
+ * Odobratie jedného odkazu na uzol. Vráti true, ak to bol posledný odkaz
+ * a uzol sa má uvoľniť.
+ */
+static bool bst_node_unref(bst_node_t *node)
+{
+#ifdef BST_PERSISTENT
+	return __atomic_sub_fetch(&BST_ENTRY(node)->refs, 1, __ATOMIC_ACQ_REL) == 0;
+#else
+	(void)node;
+	return true;
+#endif
+}
+
+/*
+ * Nahradenie uzlu, na ktorý ukazuje link, jeho kópiou, ak naň odkazuje aj
+ * iná verzia stromu. Pri chybe alokácie vráti false.
+ */
+static bool bst_unshare(bst_node_t **link)
+{
+#ifdef BST_PERSISTENT
+	bst_node_t *node = *link;
+
+	// A sole owner sees every release of the other versions
+	if (node == NULL ||
+		__atomic_load_n(&BST_ENTRY(node)->refs, __ATOMIC_ACQUIRE) == 1)
+	{
+		return true;
+	}
+
+	bst_node_t *copy = bst_node_new(node, node->key, node->value);
+	// Malloc fail
+	if (copy == NULL)
+	{
+		return false;
+	}
+
+	// The copy adds a second link to both children
+	copy->left = node->left;
+	copy->right = node->right;
+	if (copy->left != NULL)
+	{
+		bst_node_ref(copy->left);
+	}
+	if (copy->right != NULL)
+	{
+		bst_node_ref(copy->right);
+	}
+#ifdef BST_BALANCED
+	BST_ENTRY(copy)->height = BST_ENTRY(node)->height;
+#endif
+#ifdef BST_ORDER
+	BST_ENTRY(copy)->size = BST_ENTRY(node)->size;
+#endif
+
+	*link = copy;
+
+	// Every other version was disposed meanwhile, the old node is unused
+	if (bst_node_unref(node))
+	{
+		// The copy still holds both children
+		if (node->left != NULL)
+		{
+			bst_node_unref(node->left);
+		}
+		if (node->right != NULL)
+		{
+			bst_node_unref(node->right);
+		}
+		bst_node_free(node);
+	}
+#else
+	(void)link;
+#endif
+	return true;
+}
+
+/*
+ * Uvoľnenie celého stromu naraz, ak to režim alokácie umožňuje.
+ *
+ * Vráti true, ak bol strom uvoľnený a ukazovateľ nastavený na NULL.
+ */
+static bool bst_dispose_all(bst_node_t **tree)
+{
+	// Other versions may still use nodes of the pool
+#if defined(BST_POOL) && !defined(BST_PERSISTENT)
+	// The whole pool belongs to this tree
+	if (*tree != NULL)
+	{
+		bst_pool_release(BST_ENTRY(*tree)->pool);
+		*tree = NULL;
+		return true;
+	}
+#else
+	(void)tree;
+#endif
+	return false;
+}
+
+/*
+ * Synchronizácia súbežného režimu: zámky zápisu a odkladanie uvoľnenia
+ * odstránených uzlov, kým ich môže držať niektorý čitateľ.
+ */
+#ifdef BST_CONCURRENT
+#ifndef BST_STRIPES
+#define BST_STRIPES 64
+#endif
+#ifndef BST_MAX_THREADS
+#define BST_MAX_THREADS 256
+#endif
+
+// Reader state, (epoch << 1) | 1 while inside a read, 0 otherwise
+typedef struct bst_reader
+{
+	unsigned long state;
+	int in_use;
+	char padding[64 - sizeof(unsigned long) - sizeof(int)];
+} bst_reader_t;
+
+static bst_reader_t bst_readers[BST_MAX_THREADS];
+static int bst_readers_high = 0;
+static _Thread_local bst_reader_t *bst_reader = NULL;
+static pthread_key_t bst_reader_key;
+
+static pthread_mutex_t bst_stripes[BST_STRIPES];
+static pthread_once_t bst_once = PTHREAD_ONCE_INIT;
+
+static unsigned long bst_epoch = 0;
+static bst_entry_t *bst_limbo[3];
+static pthread_mutex_t bst_limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t bst_header_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Give the reader slot back when its thread exits
+static void bst_reader_exit(void *reader)
+{
+	__atomic_store_n(&((bst_reader_t *)reader)->state, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&((bst_reader_t *)reader)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void bst_concurrent_init(void)
+{
+	for (int i = 0; i < BST_STRIPES; i++)
+	{
+		pthread_mutex_init(&bst_stripes[i], NULL);
+	}
+	pthread_key_create(&bst_reader_key, bst_reader_exit);
+}
+
+/*
+ * Začiatok čítania, vlákno ohlási epochu, ktorú práve vidí.
+ */
+static void bst_read_begin(void)
+{
+	// Claim a reader slot on the first read of this thread
+	while (bst_reader == NULL)
+	{
+		pthread_once(&bst_once, bst_concurrent_init);
+		for (int i = 0; i < BST_MAX_THREADS; i++)
+		{
+			int expected = 0;
+			if (__atomic_compare_exchange_n(&bst_readers[i].in_use, &expected,
+											1, false, __ATOMIC_ACQ_REL,
+											__ATOMIC_RELAXED))
+			{
+				bst_reader = &bst_readers[i];
+				pthread_setspecific(bst_reader_key, bst_reader);
+
+				// Remember the highest slot ever used to bound the scans
+				int high = __atomic_load_n(&bst_readers_high, __ATOMIC_RELAXED);
+				while (high < i + 1 &&
+					   !__atomic_compare_exchange_n(&bst_readers_high, &high,
+													i + 1, true,
+													__ATOMIC_RELEASE,
+													__ATOMIC_RELAXED))
+				{
+				}
+				break;
+			}
+		}
+		// All slots taken, wait for a thread to exit
+		if (bst_reader == NULL)
+		{
+			sched_yield();
+		}
+	}
+
+	unsigned long epoch = __atomic_load_n(&bst_epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&bst_reader->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Koniec čítania.
+ */
+static void bst_read_end(void)
+{
+	__atomic_store_n(&bst_reader->state, 0, __ATOMIC_RELEASE);
+}
+
+// Writers of one tree pick the stripe of its header, whichever pointer they hold
+static pthread_mutex_t *bst_write_stripe(bst_node_t *header)
+{
+	return &bst_stripes[((uintptr_t)header / sizeof(bst_entry_t)) % BST_STRIPES];
+}
+
+static void bst_write_lock(bst_node_t *header)
+{
+	pthread_once(&bst_once, bst_concurrent_init);
+	pthread_mutex_lock(bst_write_stripe(header));
+}
+
+static void bst_write_unlock(bst_node_t *header)
+{
+	pthread_mutex_unlock(bst_write_stripe(header));
+}
+
+/*
+ * Odloženie uvoľnenia uzlu odpojeného od stromu.
+ *
+ * Uzol zostáva uzamknutý a jeho ukazovatele sa nemenia, lebo cez neho ešte
+ * môžu prechádzať čitatelia. Uvoľní sa, keď sa epocha posunie o dve.
+ */
+static void bst_retire(bst_node_t *node)
+{
+	bst_entry_t *reclaim = NULL;
+
+	pthread_mutex_lock(&bst_limbo_lock);
+
+	unsigned long epoch = __atomic_load_n(&bst_epoch, __ATOMIC_SEQ_CST);
+	BST_ENTRY(node)->retired = bst_limbo[epoch % 3];
+	bst_limbo[epoch % 3] = BST_ENTRY(node);
+
+	// Advance the epoch once every active reader has seen the current one
+	int high = __atomic_load_n(&bst_readers_high, __ATOMIC_ACQUIRE);
+	bool quiescent = true;
+	for (int i = 0; i < high && quiescent; i++)
+	{
+		unsigned long state = __atomic_load_n(&bst_readers[i].state,
+											  __ATOMIC_SEQ_CST);
+		quiescent = (state & 1) == 0 || (state >> 1) == epoch;
+	}
+
+	if (quiescent)
+	{
+		__atomic_store_n(&bst_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+
+		// Nodes retired two epochs ago are unreachable now
+		reclaim = bst_limbo[(epoch + 2) % 3];
+		bst_limbo[(epoch + 2) % 3] = NULL;
+	}
+
+	pthread_mutex_unlock(&bst_limbo_lock);
+
+	while (reclaim != NULL)
+	{
+		bst_entry_t *retired = reclaim->retired;
+		bst_node_free(&reclaim->node);
+		reclaim = retired;
+	}
+}
+#else
+static inline void bst_read_begin(void)
+{
+}
+
+static inline void bst_read_end(void)
+{
+}
+
+static inline void bst_write_lock(bst_node_t *header)
+{
+	(void)header;
+}
+
+static inline void bst_write_unlock(bst_node_t *header)
+{
+	(void)header;
+}
+
+static inline void bst_retire(bst_node_t *node)
+{
+	bst_node_free(node);
+}
+#endif
+
+/*
+ * Hlavička stromu v súbežnom režime.
+ *
+ * *tree ukazuje na trvalý uzol bez kľúča, ktorý sa nikdy neotáča ani
+ * neodstraňuje, a skutočný koreň visí na jeho ľavom ukazovateli. Zmena
+ * koreňa tak zmení verziu hlavičky a čitateľ zopakuje hľadanie od nej, nie
+ * od koreňa, ktorý už mohol byť odstránený. Verejné funkcie hlavičku
+ * preskočia pomocou bst_root a bst_root_link, v ostatných režimoch je *tree
+ * priamo koreň.
+ */
+#ifdef BST_CONCURRENT
+static bool bst_is_header(bst_node_t *node)
+{
+	return node != NULL && BST_ENTRY(node)->header;
+}
+
+static bst_node_t *bst_root(bst_node_t *tree)
+{
+	return bst_is_header(tree) ? BST_LOAD(tree->left) : tree;
+}
+
+static bst_node_t **bst_root_link(bst_node_t **tree)
+{
+	return bst_is_header(*tree) ? &(*tree)->left : tree;
+}
+
+// Node holding the root link, NULL for a tree without a header
+static inline bst_node_t *bst_root_owner(bst_node_t **tree)
+{
+	return bst_is_header(*tree) ? *tree : NULL;
+}
+
+/*
+ * Pridanie hlavičky stromu, ktorý ju ešte nemá. Pri chybe alokácie vráti
+ * false a strom sa nezmení.
+ */
+static bool bst_header_attach(bst_node_t **tree)
+{
+	if (bst_is_header(BST_LOAD(*tree)))
+	{
+		return true;
+	}
+
+	// Writers sharing the pointer must not both add a header
+	pthread_mutex_lock(&bst_header_lock);
+	bool attached = bst_is_header(*tree);
+	if (!attached)
+	{
+		bst_entry_t *entry = calloc(1, sizeof(bst_entry_t));
+		// Malloc fail
+		if (entry != NULL)
+		{
+			entry->header = true;
+			entry->node.left = *tree;
+			BST_PUBLISH(*tree, &entry->node);
+			attached = true;
+		}
+	}
+	pthread_mutex_unlock(&bst_header_lock);
+	return attached;
+}
+
+/*
+ * Uvoľnenie hlavičky, *tree potom ukazuje priamo na koreň.
+ */
+static void bst_header_dispose(bst_node_t **tree)
+{
+	if (bst_is_header(*tree))
+	{
+		bst_node_t *header = *tree;
+		*tree = header->left;
+		free(BST_ENTRY(header));
+	}
+}
+#else
+static inline bst_node_t *bst_root(bst_node_t *tree)
+{
+	return tree;
+}
+
+static inline bst_node_t **bst_root_link(bst_node_t **tree)
+{
+	return tree;
+}
+
+static inline bst_node_t *bst_root_owner(bst_node_t **tree)
+{
+	(void)tree;
+	return NULL;
+}
+
+static inline bool bst_header_attach(bst_node_t **tree)
+{
+	(void)tree;
+	return true;
+}
+
+static inline void bst_header_dispose(bst_node_t **tree)
+{
+	(void)tree;
+}
+#endif
 
 /*
  * Inicializácia stromu.
@@ -23,7 +860,87 @@ void bst_init(bst_node_t **tree)
 {
 	// Initialize tree to NULL
 	*tree = NULL;
+
+	// On malloc fail bst_insert adds the header later
+	bst_header_attach(tree);
+}
+
+#ifdef BST_CONCURRENT
+// The header and at most 256 nodes, keys are chars
+#define BST_READ_PATH 257
+
+/*
+ * Vyhľadanie bez zámkov pre súbežný režim.
+ *
+ * Počas zostupu sa ukladajú verzie uzlov na ceste vrátane hlavičky. Ak je
+ * niektorý uzol práve menený alebo sa do konca hľadania zmení, hľadanie sa
+ * zopakuje od hlavičky, ktorá sa nikdy neodstraňuje.
+ */
+static bool bst_search_optimistic(bst_node_t *tree, char key, int *value)
+{
+	bst_entry_t *path[BST_READ_PATH];
+	unsigned versions[BST_READ_PATH];
+
+	for (;;)
+	{
+		bst_node_t *current = tree;
+		bool found = false;
+		bool valid = true;
+		int found_value = 0;
+		int depth = 0;
+
+		bst_read_begin();
+		while (current != NULL)
+		{
+			bst_entry_t *entry = BST_ENTRY(current);
+			unsigned version = __atomic_load_n(&entry->version, __ATOMIC_ACQUIRE);
+			// Node is being changed, or concurrent changes led the path astray
+			if ((version & 1) != 0 || depth == BST_READ_PATH)
+			{
+				valid = false;
+				break;
+			}
+			path[depth] = entry;
+			versions[depth++] = version;
+
+			// The header holds no key, it only leads to the root
+			if (entry->header)
+			{
+				current = BST_LOAD(current->left);
+				continue;
+			}
+
+			char current_key = BST_LOAD(current->key);
+			if (current_key == key)
+			{
+				found_value = BST_LOAD(current->value);
+				found = true;
+				break;
+			}
+			current = current_key > key ? BST_LOAD(current->left)
+										: BST_LOAD(current->right);
+		}
+
+		// Every node on the path must be unchanged since it was read
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		for (int i = 0; valid && i < depth; i++)
+		{
+			valid = __atomic_load_n(&path[i]->version, __ATOMIC_RELAXED) ==
+					versions[i];
+		}
+		bst_read_end();
+
+		if (valid)
+		{
+			if (found)
+			{
+				*value = found_value;
+			}
+			return found;
+		}
+	}
 }
+#endif
 
 /*
  * Nájdenie uzlu v strome.
@@ -36,6 +953,9 @@ void bst_init(bst_node_t **tree)
  */
 bool bst_search(bst_node_t *tree, char key, int *value)
 {
+#ifdef BST_CONCURRENT
+	return bst_search_optimistic(tree, key, value);
+#else
 	// If tree is empty, return false
 	if (tree == NULL)
 	{
@@ -65,6 +985,7 @@ bool bst_search(bst_node_t *tree, char key, int *value)
 	}
 
 	return false;
+#endif
 }
 
 /*
@@ -80,32 +1001,53 @@ bool bst_search(bst_node_t *tree, char key, int *value)
  */
 void bst_insert(bst_node_t **tree, char key, int value)
 {
-	// If tree is empty, create new node
-	if (*tree == NULL)
+	// Malloc fail while creating the tree header
+	if (!bst_header_attach(tree))
 	{
-		*tree = malloc(sizeof(bst_node_t));
-		if (*tree == NULL)
-		{
-			return;
-		}
-		// Set values
-		(*tree)->key = key;
-		(*tree)->value = value;
-		(*tree)->left = NULL;
-		(*tree)->right = NULL;
+		return;
+	}
+	// Concurrent writers of the tree all lock its permanent header
+	bst_node_t *header = *tree;
+	bst_write_lock(header);
+
+	bst_node_t **root = bst_root_link(tree);
+
+	// If tree is empty, create new node, stays NULL on malloc fail
+	if (*root == NULL)
+	{
+		BST_PUBLISH(*root, bst_node_new(NULL, key, value));
+		bst_write_unlock(header);
+		return;
+	}
 
+	// Malloc fail while copying a node shared with another version
+	if (!bst_unshare(root))
+	{
+		bst_write_unlock(header);
 		return;
 	}
 
 	// If tree is not empty, search for node with given key
-	bst_node_t *current = *tree;
+	bst_node_t *current = *root;
+
+#ifdef BST_REPAIR_PATHS
+	// Links to the visited nodes, repaired bottom-up after the insert
+	bst_node_t **path[BST_MAX_HEIGHT];
+	int depth = 0;
+	path[depth++] = root;
+	// Node holding the root link, the header in the concurrent mode
+	bst_node_t *owner = bst_root_owner(tree);
+#endif
 
 	while (current != NULL)
 	{
 		// If key equals the key of current node, set value to key
 		if (current->key == key)
 		{
-			current->value = value;
+			bst_node_lock(current);
+			BST_PUBLISH(current->value, value);
+			bst_node_unlock(current);
+			bst_write_unlock(header);
 			return;
 		}
 		// If key of current node is bigger than given key, search in left subtree
@@ -113,13 +1055,17 @@ void bst_insert(bst_node_t **tree, char key, int value)
 		{
 			if (current->left == NULL)
 			{
-				bst_node_t *new = malloc(sizeof(bst_node_t));
-				new->key = key;
-				new->value = value;
-				new->left = new->right = NULL;
-				current->left = new;
-				return;
+				BST_PUBLISH(current->left, bst_node_new(current, key, value));
+				break;
 			}
+			// Malloc fail while copying a node shared with another version
+			if (!bst_unshare(&current->left))
+			{
+				break;
+			}
+#ifdef BST_REPAIR_PATHS
+			path[depth++] = &current->left;
+#endif
 			current = current->left;
 		}
 		// Otherwise, search right subtree
@@ -127,16 +1073,31 @@ void bst_insert(bst_node_t **tree, char key, int value)
 		{
 			if (current->right == NULL)
 			{
-				bst_node_t *new = malloc(sizeof(bst_node_t));
-				new->key = key;
-				new->value = value;
-				new->left = new->right = NULL;
-				current->right = new;
-				return;
+				BST_PUBLISH(current->right, bst_node_new(current, key, value));
+				break;
+			}
+			// Malloc fail while copying a node shared with another version
+			if (!bst_unshare(&current->right))
+			{
+				break;
 			}
+#ifdef BST_REPAIR_PATHS
+			path[depth++] = &current->right;
+#endif
 			current = current->right;
 		}
 	}
+
+#ifdef BST_REPAIR_PATHS
+	// Restore sizes and balance from the new leaf's parent up to the root
+	while (depth > 0)
+	{
+		depth--;
+		bst_repair(depth > 0 ? *path[depth - 1] : owner, path[depth]);
+	}
+#endif
+
+	bst_write_unlock(header);
 }
 
 /*
@@ -154,34 +1115,60 @@ void bst_insert(bst_node_t **tree, char key, int value)
  */
 void bst_replace_by_rightmost(bst_node_t *target, bst_node_t **tree)
 {
-	// Store current node and its parent
-	bst_node_t *current = *tree;
-	bst_node_t *previous = NULL;
+	// Store the link pointing to the current node
+	bst_node_t **link = tree;
+
+#ifdef BST_REPAIR_PATHS
+	// Links to the visited nodes, repaired bottom-up after the removal
+	bst_node_t **path[BST_MAX_HEIGHT];
+	int depth = 0;
+#endif
+
+	// Malloc fail while copying a node shared with another version
+	if (!bst_unshare(link))
+	{
+		return;
+	}
 
 	// Find rightmost node
-	while (current->right != NULL)
+	while ((*link)->right != NULL)
 	{
-		previous = current;
-		current = current->right;
+#ifdef BST_REPAIR_PATHS
+		path[depth++] = link;
+#endif
+		link = &(*link)->right;
+
+		// Malloc fail while copying a node shared with another version
+		if (!bst_unshare(link))
+		{
+			return;
+		}
 	}
 
+	bst_node_t *current = *link;
+	bst_node_lock(target);
+	bst_node_lock(current);
+
 	// Fill target with rightmost values
-	target->key = current->key;
-	target->value = current->value;
+	BST_PUBLISH(target->key, current->key);
+	BST_PUBLISH(target->value, current->value);
 
-	// If rightmost node has left child, replace rightmost node with its left child
-	if (previous != NULL)
-	{
-		previous->right = NULL;
-	}
+	// Move rightmost node's left child (possibly NULL) to its place
+	BST_PUBLISH(*link, current->left);
+	bst_set_parent(current->left, bst_parent(current));
 
-	// If rightmost node has left child, move it to rightmost node's place
-	if (current->left)
+	bst_node_unlock(target);
+	bst_retire(current);
+
+#ifdef BST_REPAIR_PATHS
+	// Restore sizes and balance from the removed node's parent up to the subtree root
+	while (depth > 0)
 	{
-		previous->right = current->left;
+		// In bst_delete the subtree hangs off target
+		depth--;
+		bst_repair(depth > 0 ? *path[depth - 1] : target, path[depth]);
 	}
-
-	free(current);
+#endif
 }
 
 /*
@@ -198,344 +1185,862 @@ void bst_replace_by_rightmost(bst_node_t *target, bst_node_t **tree)
  */
 void bst_delete(bst_node_t **tree, char key)
 {
+	// Concurrent writers of the tree all lock its permanent header
+	bst_node_t *header = BST_LOAD(*tree);
+	bst_write_lock(header);
+
+	bst_node_t **root = bst_root_link(tree);
+
 	// If tree is empty, return
-	if (*tree == NULL)
+	if (*root == NULL)
+	{
+		bst_write_unlock(header);
+		return;
+	}
+
+	// Malloc fail while copying a node shared with another version
+	if (!bst_unshare(root))
 	{
+		bst_write_unlock(header);
 		return;
 	}
 
-	// If tree is not empty, search for node with given key
-	bst_node_t *current = *tree;
-	bst_node_t *previous = NULL;
-
-	char side;
+	// If tree is not empty, search for node with given key
+	bst_node_t *current = *root;
+	// Link pointing to the current node, either the root or a parent's child
+	bst_node_t **link = root;
+
+#ifdef BST_REPAIR_PATHS
+	// Links to the visited nodes, repaired bottom-up after the removal
+	bst_node_t **path[BST_MAX_HEIGHT];
+	int depth = 0;
+	path[depth++] = root;
+	// Node holding the root link, the header in the concurrent mode
+	bst_node_t *owner = bst_root_owner(tree);
+#endif
+
+	// Find node with given key
+	while (current != NULL)
+	{
+		if (current->key == key)
+		{
+			break;
+		}
+
+		else if (current->key < key)
+		{
+			link = &current->right;
+		}
+
+		else if (current->key > key)
+		{
+			link = &current->left;
+		}
+
+		// Malloc fail while copying a node shared with another version
+		if (!bst_unshare(link))
+		{
+			bst_write_unlock(header);
+			return;
+		}
+
+		current = *link;
+#ifdef BST_REPAIR_PATHS
+		path[depth++] = link;
+#endif
+	}
+
+	// If node with given key was not found, return
+	if (current == NULL)
+	{
+		bst_write_unlock(header);
+		return;
+	}
+
+	// If the node has both children, replace it with rightmost node
+	if (current->left != NULL && current->right != NULL)
+	{
+		bst_replace_by_rightmost(current, &(current->left));
+	}
+
+	// Node has at most one child, its parent (or the root) inherits it
+	else
+	{
+		bst_node_lock(current);
+		bst_node_t *child = current->left != NULL ? current->left : current->right;
+		BST_PUBLISH(*link, child);
+		bst_set_parent(child, bst_parent(current));
+		bst_retire(current);
+	}
+
+#ifdef BST_REPAIR_PATHS
+	// Restore sizes and balance from the deleted node up to the root
+	while (depth > 0)
+	{
+		depth--;
+		bst_repair(depth > 0 ? *path[depth - 1] : owner, path[depth]);
+	}
+#endif
+
+	bst_write_unlock(header);
+}
+
+/*
+ * Zrušenie celého stromu.
+ *
+ * Po zrušení sa celý strom bude nachádzať v rovnakom stave ako po
+ * inicializácii. Funkcia korektne uvoľní všetky alokované zdroje rušených
+ * uzlov.
+ *
+ * Rovnako ako bst_preorder používa lokálny rastúci zásobník.
+ */
+void bst_dispose(bst_node_t **tree)
+{
+	bst_stack_t stack;
+	bst_stack_init(&stack);
+	bst_dispose_stack(tree, &stack);
+	bst_stack_dispose(&stack);
+}
+
+/*
+ * Preorder prechod stromom.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ *
+ * Prechod používa lokálny zásobník bst_stack_t. Ten má prvých
+ * BST_STACK_INLINE položiek priamo v sebe a pamäť alokuje až pre hlbšie
+ * stromy, takže hĺbka stromu nie je obmedzená pevnou kapacitou.
+ */
+void bst_preorder(bst_node_t *tree)
+{
+	bst_stack_t stack;
+	bst_stack_init(&stack);
+	bst_preorder_stack(tree, &stack);
+	bst_stack_dispose(&stack);
+}
+
+/*
+ * Inorder prechod stromom.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ *
+ * Rovnako ako bst_preorder používa lokálny rastúci zásobník.
+ */
+void bst_inorder(bst_node_t *tree)
+{
+	bst_stack_t stack;
+	bst_stack_init(&stack);
+	bst_inorder_stack(tree, &stack);
+	bst_stack_dispose(&stack);
+}
+
+/*
+ * Postorder prechod stromom.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ *
+ * Prechod používa jediný zásobník uzlov a pamätá si naposledy spracovaný
+ * uzol. Uzol na vrchole zásobníku sa spracuje, ak nemá pravý podstrom alebo
+ * ak je naposledy spracovaný uzol jeho pravým potomkom. Inak sa na zásobník
+ * vloží ľavá vetva jeho pravého podstromu. Každý uzol sa tak na zásobník
+ * vloží a z neho vyberie iba raz. Zásobník je lokálny a rastúci ako
+ * v bst_preorder.
+ */
+void bst_postorder(bst_node_t *tree)
+{
+	bst_stack_t stack;
+	bst_stack_init(&stack);
+	bst_postorder_stack(tree, &stack);
+	bst_stack_dispose(&stack);
+}
+
+/*
+ * Inorder prechod stromom bez zásobníku (Morrisov prechod).
+ *
+ * Pred zostupom do ľavého podstromu sa pravý ukazovateľ jeho najpravejšieho
+ * uzlu dočasne nasmeruje späť na aktuálny uzol. Pri druhom príchode sa
+ * ukazovateľ vráti na NULL, takže po skončení je strom nezmenený.
+ *
+ * V režimoch BST_PERSISTENT a BST_CONCURRENT môžu uzly počas prechodu čítať
+ * iné vlákna, preto sa namiesto previazania použije bst_inorder.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ */
+void bst_inorder_morris(bst_node_t *tree)
+{
+#if defined(BST_PERSISTENT) || defined(BST_CONCURRENT)
+	// Threading would change nodes other versions or readers walk meanwhile
+	bst_inorder(tree);
+#else
+	bst_node_t *current = bst_root(tree);
+
+	while (current != NULL)
+	{
+		// No left subtree, visit and continue right
+		if (current->left == NULL)
+		{
+			bst_print_node(current);
+			current = current->right;
+			continue;
+		}
+
+		// Find inorder predecessor
+		bst_node_t *predecessor = current->left;
+		while (predecessor->right != NULL && predecessor->right != current)
+		{
+			predecessor = predecessor->right;
+		}
+
+		// First visit, thread the predecessor back to current
+		if (predecessor->right == NULL)
+		{
+			predecessor->right = current;
+			current = current->left;
+		}
+		// Second visit, left subtree is done, restore and visit
+		else
+		{
+			predecessor->right = NULL;
+			bst_print_node(current);
+			current = current->right;
+		}
+	}
+#endif
+}
+
+/*
+ * Preorder prechod stromom bez zásobníku (Morrisov prechod).
+ *
+ * Rovnaké dočasné previazanie ako bst_inorder_morris, uzol sa spracuje pri
+ * prvom príchode. V režimoch BST_PERSISTENT a BST_CONCURRENT sa použije
+ * bst_preorder.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ */
+void bst_preorder_morris(bst_node_t *tree)
+{
+#if defined(BST_PERSISTENT) || defined(BST_CONCURRENT)
+	// Threading would change nodes other versions or readers walk meanwhile
+	bst_preorder(tree);
+#else
+	bst_node_t *current = bst_root(tree);
 
-	// Find node with given key
 	while (current != NULL)
 	{
-		if (current->key == key)
+		// No left subtree, visit and continue right
+		if (current->left == NULL)
 		{
-			break;
+			bst_print_node(current);
+			current = current->right;
+			continue;
 		}
 
-		else if (current->key < key)
+		// Find inorder predecessor
+		bst_node_t *predecessor = current->left;
+		while (predecessor->right != NULL && predecessor->right != current)
 		{
-			previous = current;
-			current = current->right;
-			side = 'r';
+			predecessor = predecessor->right;
 		}
 
-		else if (current->key > key)
+		// First visit, print and thread the predecessor back to current
+		if (predecessor->right == NULL)
 		{
-			previous = current;
+			bst_print_node(current);
+			predecessor->right = current;
 			current = current->left;
-			side = 'l';
+		}
+		// Second visit, left subtree is done, restore
+		else
+		{
+			predecessor->right = NULL;
+			current = current->right;
 		}
 	}
+#endif
+}
 
-	// If node with given key was not found, return
-	if (current == NULL)
+/*
+ * Inicializácia rastúceho zásobníku.
+ */
+void bst_stack_init(bst_stack_t *stack)
+{
+	stack->items = stack->inline_items;
+	stack->top = -1;
+	stack->capacity = BST_STACK_INLINE;
+}
+
+/*
+ * Uvoľnenie pamäte rastúceho zásobníku, zásobník ostane inicializovaný.
+ */
+void bst_stack_dispose(bst_stack_t *stack)
+{
+	// Only grown stacks own heap memory
+	if (stack->items != stack->inline_items)
 	{
-		return;
+		free(stack->items);
 	}
+	bst_stack_init(stack);
+}
 
-	// If the node has both children, replace it with rightmost node
-	if (current->left != NULL && current->right != NULL)
+/*
+ * Vloženie uzlu na rastúci zásobník, pri chybe alokácie vráti false.
+ */
+static bool bst_stack_push(bst_stack_t *stack, bst_node_t *node)
+{
+	// Stack is full, double its capacity
+	if (stack->top + 1 == stack->capacity)
 	{
-		bst_replace_by_rightmost(current, &(current->left));
+		int capacity = stack->capacity * 2;
+		bst_node_t **items = malloc(capacity * sizeof(bst_node_t *));
+		// Malloc fail
+		if (items == NULL)
+		{
+			return false;
+		}
+
+		memcpy(items, stack->items, stack->capacity * sizeof(bst_node_t *));
+		if (stack->items != stack->inline_items)
+		{
+			free(stack->items);
+		}
+
+		stack->items = items;
+		stack->capacity = capacity;
 	}
 
-	// Node has only one child
-	else
+	stack->top++;
+	stack->items[stack->top] = node;
+	return true;
+}
+
+/*
+ * Prechod stromom v poradí order so zásobníkom volajúceho, ktorý pre každý
+ * uzol zavolá visit.
+ *
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil alebo
+ * zlyhala alokácia zásobníku.
+ */
+bool bst_visit_stack(bst_node_t *tree, bst_order_t order, bst_stack_t *stack,
+					 bst_visitor_t visit, void *context)
+{
+	stack->top = -1;
+
+	bst_node_t *current = bst_root(tree);
+	// Last node visited in postorder, tells whether a right subtree is done
+	bst_node_t *last = NULL;
+	while (current != NULL || stack->top >= 0)
 	{
-		// Node only has right child
-		if (current->left == NULL)
+		// Push the left spine
+		if (current != NULL)
 		{
-			// Child was the left node of its parent
-			if (side == 'l')
+			if (order == BST_PREORDER && !visit(current, context))
 			{
-				previous->left = current->right;
+				return false;
 			}
-			// Child was the right node of its parent
-			else if (side == 'r')
+			if (!bst_stack_push(stack, current))
 			{
-				previous->right = current->right;
+				return false;
 			}
+			current = current->left;
+			continue;
 		}
-		// Node only has left child
-		if (current->right == NULL)
+
+		// Left subtree of the top node is done
+		bst_node_t *top = stack->items[stack->top];
+
+		// Postorder keeps the node until its right subtree is done too
+		if (order == BST_POSTORDER)
 		{
-			// Child was the left node of its parent
-			if (side == 'l')
+			if (top->right != NULL && top->right != last)
 			{
-				previous->left = current->left;
+				current = top->right;
+				continue;
 			}
-			// Child was the right node of its parent
-			else if (side == 'r')
+			stack->top--;
+			last = top;
+			if (!visit(top, context))
 			{
-				previous->right = current->left;
+				return false;
 			}
+			continue;
 		}
 
-		free(current);
+		stack->top--;
+		if (order == BST_INORDER && !visit(top, context))
+		{
+			return false;
+		}
+		current = top->right;
 	}
+
+	return true;
 }
 
 /*
- * Zrušenie celého stromu.
+ * Prechod stromom v poradí order, ktorý pre každý uzol zavolá visit.
  *
- * Po zrušení sa celý strom bude nachádzať v rovnakom stave ako po
- * inicializácii. Funkcia korektne uvoľní všetky alokované zdroje rušených
- * uzlov.
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil.
+ */
+bool bst_visit(bst_node_t *tree, bst_order_t order, bst_visitor_t visit,
+			   void *context)
+{
+	bst_stack_t stack;
+	bst_stack_init(&stack);
+
+	bool result = bst_visit_stack(tree, order, &stack, visit, context);
+
+	bst_stack_dispose(&stack);
+	return result;
+}
+
+// Visitor for the printing traversals
+static bool bst_print_visit(bst_node_t *node, void *context)
+{
+	(void)context;
+	bst_print_node(node);
+	return true;
+}
+
+/*
+ * Preorder prechod stromom so zásobníkom volajúceho.
  *
- * Funkciu implementujte iteratívne pomocou zásobníku uzlov a bez použitia
- * vlastných pomocných funkcií.
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
  */
-void bst_dispose(bst_node_t **tree)
+void bst_preorder_stack(bst_node_t *tree, bst_stack_t *stack)
 {
-	// If tree is empty, return
-	if (*tree == NULL)
-	{
-		return;
-	}
+	bst_visit_stack(tree, BST_PREORDER, stack, bst_print_visit, NULL);
+}
 
-	// Create stack
-	stack_bst_t *stack = malloc(sizeof(stack_bst_t));
-	// Malloc fail
-	if (stack == NULL)
+/*
+ * Inorder prechod stromom so zásobníkom volajúceho.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ */
+void bst_inorder_stack(bst_node_t *tree, bst_stack_t *stack)
+{
+	bst_visit_stack(tree, BST_INORDER, stack, bst_print_visit, NULL);
+}
+
+/*
+ * Postorder prechod stromom so zásobníkom volajúceho.
+ *
+ * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
+ */
+void bst_postorder_stack(bst_node_t *tree, bst_stack_t *stack)
+{
+	bst_visit_stack(tree, BST_POSTORDER, stack, bst_print_visit, NULL);
+}
+
+/*
+ * Zrušenie celého stromu so zásobníkom volajúceho.
+ *
+ * Po zrušení sa celý strom bude nachádzať v rovnakom stave ako po
+ * inicializácii.
+ */
+void bst_dispose_stack(bst_node_t **tree, bst_stack_t *stack)
+{
+	bst_header_dispose(tree);
+
+	// Pooled trees are released in one step
+	if (bst_dispose_all(tree))
 	{
 		return;
 	}
-	// Initialize stack
-	stack_bst_init(stack);
+
+	stack->top = -1;
 
 	bst_node_t *current = *tree;
 
 	// Go through the tree until it is empty
-	while (stack_bst_empty(stack) == false || current != NULL)
+	while (stack->top >= 0 || current != NULL)
 	{
-		// If current node is NULL, stack must not be empty
 		// Pop node from stack
 		if (current == NULL)
 		{
-			current = stack_bst_pop(stack);
+			current = stack->items[stack->top--];
+		}
+
+		// A node still used by another version keeps its subtree
+		if (!bst_node_unref(current))
+		{
+			current = NULL;
+			continue;
 		}
 
-		// Push right child to stack if it exists
-		if (current->right != NULL)
+		// Push right child to stack if it exists, on malloc fail free it
+		// right away with the plain dispose
+		if (current->right != NULL && !bst_stack_push(stack, current->right))
 		{
-			stack_bst_push(stack, current->right);
+			bst_dispose(&current->right);
 		}
 
 		// Move current node to the left child
-		// Store the current node to be deleted
 		bst_node_t *tmp = current;
 		current = current->left;
-		free(tmp);
+		bst_node_free(tmp);
 	}
 
-	// Free stack and set tree to NULL
 	*tree = NULL;
-	free(stack);
 }
 
+// Keys are chars, so a built tree has at most 256 nodes and 9 levels
+#define BST_BUILD_STACK 32
+
 /*
- * Pomocná funkcia pre iteratívny preorder.
+ * Vytvorenie dokonale vyváženého stromu z count usporiadaných kľúčov.
  *
- * Prechádza po ľavej vetve k najľavejšiemu uzlu podstromu.
- * Nad spracovanými uzlami zavola bst_print_node a uloží ich do zásobníku uzlov.
+ * Zásobník obsahuje ešte nevytvorené podstromy ako ukazovateľ, kam sa ich
+ * koreň zapíše, a úsek poľa kľúčov. Pri chybe alokácie vráti false, už
+ * vytvorené uzly zostávajú v strome.
+ */
+static bool bst_build_range(bst_node_t **tree, const char *keys,
+							const int *values, int count)
+{
+	bst_node_t **links[BST_BUILD_STACK];
+	bst_node_t *parents[BST_BUILD_STACK];
+	int firsts[BST_BUILD_STACK];
+	int counts[BST_BUILD_STACK];
+	int top = 0;
+
+	if (count <= 0)
+	{
+		return true;
+	}
+
+	links[0] = tree;
+	parents[0] = NULL;
+	firsts[0] = 0;
+	counts[0] = count;
+
+	while (top >= 0)
+	{
+		bst_node_t **link = links[top];
+		bst_node_t *parent = parents[top];
+		int first = firsts[top];
+		int size = counts[top];
+		top--;
+
+		// Middle key becomes the root, the halves form its subtrees
+		int middle = first + size / 2;
+		*link = bst_node_new_sized(parent, count, keys[middle], values[middle]);
+		// Malloc fail
+		if (*link == NULL)
+		{
+			return false;
+		}
+
+#ifdef BST_BALANCED
+		// A perfect subtree of size nodes is as high as size has bits
+		int height = 0;
+		for (int rest = size; rest > 0; rest /= 2)
+		{
+			height++;
+		}
+		BST_ENTRY(*link)->height = height;
+#endif
+#ifdef BST_ORDER
+		BST_ENTRY(*link)->size = size;
+#endif
+
+		int left = size / 2;
+		int right = size - left - 1;
+		if (right > 0)
+		{
+			top++;
+			links[top] = &(*link)->right;
+			parents[top] = *link;
+			firsts[top] = middle + 1;
+			counts[top] = right;
+		}
+		if (left > 0)
+		{
+			top++;
+			links[top] = &(*link)->left;
+			parents[top] = *link;
+			firsts[top] = first;
+			counts[top] = left;
+		}
+	}
+	return true;
+}
+
+/*
+ * Inicializácia kurzoru, kurzor je za koncom.
+ */
+void bst_cursor_init(bst_cursor_t *cursor)
+{
+	bst_stack_init(&cursor->path);
+	cursor->failed = false;
+}
+
+/*
+ * Uvoľnenie pamäte kurzoru, kurzor ostane inicializovaný.
+ */
+void bst_cursor_dispose(bst_cursor_t *cursor)
+{
+	bst_stack_dispose(&cursor->path);
+	cursor->failed = false;
+}
+
+/*
+ * Prechod po ľavej (left == true) alebo pravej vetve podstromu tree
+ * a vloženie jej uzlov na cestu kurzoru, ako pri inorder prechode.
  *
- * Funkciu implementujte iteratívne pomocou zásobníku uzlov a bez použitia
- * vlastných pomocných funkcií.
+ * Pri chybe alokácie presunie kurzor za koniec a vráti false.
  */
-void bst_leftmost_preorder(bst_node_t *tree, stack_bst_t *to_visit)
+static bool bst_cursor_descend(bst_cursor_t *cursor, bst_node_t *tree,
+							   bool left)
 {
 	bst_node_t *current = tree;
 
-	// Go through the tree until it is empty
 	while (current != NULL)
 	{
-		// Print node and push it to stack
-		bst_print_node(current);
-		stack_bst_push(to_visit, current);
-		// Continue with left child
-		current = current->left;
+		// Malloc fail
+		if (!bst_stack_push(&cursor->path, current))
+		{
+			cursor->path.top = -1;
+			cursor->failed = true;
+			return false;
+		}
+		current = left ? current->left : current->right;
 	}
+	return true;
 }
 
 /*
- * Preorder prechod stromom.
- *
- * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
- *
- * Funkciu implementujte iteratívne pomocou funkcie bst_leftmost_preorder a
- * zásobníku uzlov bez použitia vlastných pomocných funkcií.
+ * Posun kurzoru k susednému kľúču v smere forward.
  */
-void bst_preorder(bst_node_t *tree)
+static bool bst_cursor_step(bst_cursor_t *cursor, bool forward)
 {
-	// Create stack
-	stack_bst_t *stack = malloc(sizeof(stack_bst_t));
-	// Malloc fail
-	if (stack == NULL)
+	bst_stack_t *path = &cursor->path;
+
+	// Cursor is past the end
+	if (path->top < 0)
 	{
-		return;
+		return false;
 	}
 
-	// Initialize stack
-	stack_bst_init(stack);
-	// Call leftmost preorder
-	bst_leftmost_preorder(tree, stack);
+	bst_node_t *current = path->items[path->top];
+	bst_node_t *subtree = forward ? current->right : current->left;
 
-	// Go through the tree until the stack is empty
-	while (stack_bst_empty(stack) == false)
+	// Neighbour is the nearest node of the subtree on that side
+	if (subtree != NULL)
 	{
-		// Pop unvisited node from stack
-		tree = stack_bst_pop(stack);
-		// Call leftmost preorder on the right child
-		bst_leftmost_preorder(tree->right, stack);
+		return bst_cursor_descend(cursor, subtree, forward);
 	}
 
-	// Free stack
-	free(stack);
+	// Otherwise it is the first ancestor reached from the other side
+	bst_node_t *child;
+	do
+	{
+		child = path->items[path->top--];
+	} while (path->top >= 0 &&
+			 (forward ? path->items[path->top]->right
+					  : path->items[path->top]->left) == child);
+
+	return path->top >= 0;
+}
+
+bool bst_cursor_first(bst_cursor_t *cursor, bst_node_t *tree)
+{
+	cursor->path.top = -1;
+	cursor->failed = false;
+	return bst_cursor_descend(cursor, bst_root(tree), true) &&
+		   cursor->path.top >= 0;
+}
+
+bool bst_cursor_last(bst_cursor_t *cursor, bst_node_t *tree)
+{
+	cursor->path.top = -1;
+	cursor->failed = false;
+	return bst_cursor_descend(cursor, bst_root(tree), false) &&
+		   cursor->path.top >= 0;
 }
 
 /*
- * Pomocná funkcia pre iteratívny inorder.
+ * Nastavenie kurzoru na najmenší kľúč väčší alebo rovný key.
  *
- * Prechádza po ľavej vetve k najľavejšiemu uzlu podstromu a ukladá uzly do
- * zásobníku uzlov.
- *
- * Funkciu implementujte iteratívne pomocou zásobníku uzlov a bez použitia
- * vlastných pomocných funkcií.
+ * Cesta sa ukladá počas zostupu a nakoniec sa skráti k poslednému uzlu,
+ * ktorého kľúč nie je menší ako key.
  */
-void bst_leftmost_inorder(bst_node_t *tree, stack_bst_t *to_visit)
+bool bst_cursor_seek(bst_cursor_t *cursor, bst_node_t *tree, char key)
 {
-	bst_node_t *current = tree;
+	bst_stack_t *path = &cursor->path;
+	bst_node_t *current = bst_root(tree);
+	int found = -1;
 
-	// Go through the tree until it is empty
+	path->top = -1;
+	cursor->failed = false;
 	while (current != NULL)
 	{
-		// Push node to stack
-		stack_bst_push(to_visit, current);
-		// Continue with left child
-		current = current->left;
+		// Malloc fail
+		if (!bst_stack_push(path, current))
+		{
+			path->top = -1;
+			cursor->failed = true;
+			return false;
+		}
+
+		if (current->key == key)
+		{
+			found = path->top;
+			break;
+		}
+		// Candidate, but a smaller one may be in the left subtree
+		if (current->key > key)
+		{
+			found = path->top;
+			current = current->left;
+		}
+		else
+		{
+			current = current->right;
+		}
 	}
+
+	path->top = found;
+	return found >= 0;
+}
+
+bool bst_cursor_next(bst_cursor_t *cursor)
+{
+	return bst_cursor_step(cursor, true);
+}
+
+bool bst_cursor_prev(bst_cursor_t *cursor)
+{
+	return bst_cursor_step(cursor, false);
+}
+
+bst_node_t *bst_cursor_node(const bst_cursor_t *cursor)
+{
+	return cursor->path.top >= 0 ? cursor->path.items[cursor->path.top] : NULL;
 }
 
 /*
- * Inorder prechod stromom.
- *
- * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
- *
- * Funkciu implementujte iteratívne pomocou funkcie bst_leftmost_inorder a
- * zásobníku uzlov bez použitia vlastných pomocných funkcií.
+ * Prechod kľúčov z intervalu [low, high) vzostupne.
  */
-void bst_inorder(bst_node_t *tree)
+bool bst_visit_range(bst_node_t *tree, char low, char high,
+					 bst_visitor_t visit, void *context)
 {
-	// Create stack
-	stack_bst_t *stack = malloc(sizeof(stack_bst_t));
+	bst_cursor_t cursor;
+	bool finished = true;
 
-	// Malloc fail
-	if (stack == NULL)
+	bst_cursor_init(&cursor);
+	bool valid = bst_cursor_seek(&cursor, tree, low);
+	while (valid && bst_cursor_node(&cursor)->key < high)
 	{
-		return;
+		if (!visit(bst_cursor_node(&cursor), context))
+		{
+			finished = false;
+			break;
+		}
+		valid = bst_cursor_next(&cursor);
 	}
-	// Initialize stack
-	stack_bst_init(stack);
-
-	// Call leftmost inorder
-	bst_leftmost_inorder(tree, stack);
 
-	// Go through the tree until the stack is empty
-	while (stack_bst_empty(stack) == false)
+	// Malloc fail ended the scan early
+	if (cursor.failed)
 	{
-		// Pop unvisited node from stack
-		tree = stack_bst_pop(stack);
-		// Print node
-		bst_print_node(tree);
-		// Call leftmost inorder on the right child
-		bst_leftmost_inorder(tree->right, stack);
+		finished = false;
 	}
-
-	// Free stack
-	free(stack);
+	bst_cursor_dispose(&cursor);
+	return finished;
 }
 
+#ifdef BST_PARENT
 /*
- * Pomocná funkcia pre iteratívny postorder.
- *
- * Prechádza po ľavej vetve k najľavejšiemu uzlu podstromu a ukladá uzly do
- * zásobníku uzlov. Do zásobníku bool hodnôt ukladá informáciu že uzol
- * bol navštívený prvý krát.
- *
- * Funkciu implementujte iteratívne pomocou zásobníkov uzlov a bool hodnôt a bez použitia
- * vlastných pomocných funkcií.
+ * Prvý uzol podstromu tree v inorder poradí (najmenší kľúč).
  */
-void bst_leftmost_postorder(bst_node_t *tree, stack_bst_t *to_visit,
-							stack_bool_t *first_visit)
+bst_node_t *bst_inorder_first(bst_node_t *tree)
 {
-	bst_node_t *current = tree;
+	tree = bst_root(tree);
 
-	// Go through the tree until it is empty
-	while (current != NULL)
+	while (tree != NULL && tree->left != NULL)
 	{
-		// Push node to stack
-		stack_bst_push(to_visit, current);
-		// Push true to stack that the node has been visited for the first time
-		stack_bool_push(first_visit, true);
-		// Continue with left child
-		current = current->left;
+		tree = tree->left;
 	}
+	return tree;
 }
 
 /*
- * Postorder prechod stromom.
- *
- * Pre aktuálne spracovávaný uzol nad ním zavolajte funkciu bst_print_node.
- *
- * Funkciu implementujte iteratívne pomocou funkcie bst_leftmost_postorder a
- * zásobníkov uzlov a bool hodnôt bez použitia vlastných pomocných funkcií.
+ * Nasledujúci uzol v inorder poradí alebo NULL pre posledný uzol.
  */
-void bst_postorder(bst_node_t *tree)
+bst_node_t *bst_inorder_next(bst_node_t *node)
 {
-	// Create stacks and initialize them
-	stack_bst_t *stack_bst = malloc(sizeof(stack_bst_t));
-	stack_bst_init(stack_bst);
-
-	stack_bool_t *stack_bool = malloc(sizeof(stack_bool_t));
-	stack_bool_init(stack_bool);
-
-	// Malloc fail
-	if (stack_bst == NULL || stack_bool == NULL)
+	// Successor is the leftmost node of the right subtree
+	if (node->right != NULL)
 	{
-		return;
+		return bst_inorder_first(node->right);
 	}
 
-	// Call leftmost postorder
-	bst_leftmost_postorder(tree, stack_bst, stack_bool);
+	// Otherwise it is the first ancestor reached from its left subtree
+	bst_node_t *parent = bst_parent(node);
+	while (parent != NULL && parent->right == node)
+	{
+		node = parent;
+		parent = bst_parent(node);
+	}
+	return parent;
+}
 
-	// Go through the tree until the stack is empty
-	bst_node_t *current = tree;
-	while (stack_bst_empty(stack_bst) == false)
+/*
+ * Predchádzajúci uzol v inorder poradí alebo NULL pre prvý uzol.
+ */
+bst_node_t *bst_inorder_prev(bst_node_t *node)
+{
+	// Predecessor is the rightmost node of the left subtree
+	if (node->left != NULL)
 	{
-		// Pop unvisited node from stack
-		current = stack_bst_pop(stack_bst);
-		// Pop bool value from stack, if it is true, push the node back to the stack
-		// and call leftmost postorder on the right child
-		if (stack_bool_pop(stack_bool) == true)
-		{
-			stack_bst_push(stack_bst, current);
-			stack_bool_push(stack_bool, false);
-			bst_leftmost_postorder(current->right, stack_bst, stack_bool);
-		}
-		// If the bool value is false, print the node
-		else
+		node = node->left;
+		while (node->right != NULL)
 		{
-			bst_print_node(current);
+			node = node->right;
 		}
+		return node;
+	}
+
+	// Otherwise it is the first ancestor reached from its right subtree
+	bst_node_t *parent = bst_parent(node);
+	while (parent != NULL && parent->left == node)
+	{
+		node = parent;
+		parent = bst_parent(node);
+	}
+	return parent;
+}
+
+/*
+ * Prvý uzol podstromu tree v postorder poradí.
+ */
+bst_node_t *bst_postorder_first(bst_node_t *tree)
+{
+	tree = bst_root(tree);
+
+	// Go down, preferring left children, until a leaf is reached
+	while (tree != NULL && (tree->left != NULL || tree->right != NULL))
+	{
+		tree = tree->left != NULL ? tree->left : tree->right;
 	}
+	return tree;
+}
+
+/*
+ * Nasledujúci uzol v postorder poradí alebo NULL pre koreň.
+ */
+bst_node_t *bst_postorder_next(bst_node_t *node)
+{
+	bst_node_t *parent = bst_parent(node);
 
-	// Free stacks
-	free(stack_bst);
-	free(stack_bool);
+	// Coming up from the left, the right subtree of the parent goes first
+	if (parent != NULL && parent->left == node && parent->right != NULL)
+	{
+		return bst_postorder_first(parent->right);
+	}
+	return parent;
 }
+#endif
+
+/*
+ * Rozšírenia spoločné pre obe varianty.
+ */
+#include "../btree_shared.h"
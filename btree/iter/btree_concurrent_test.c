@@ -0,0 +1,224 @@
+/*
+ * Záťažový test a meranie súbežného režimu iteratívnej varianty
+ *
+ * Niekoľko zapisujúcich vlákien vkladá a maže kľúče, kým čitatelia bez zámkov
+ * hľadajú stále kľúče, ktoré musia nájsť vždy a so správnou hodnotou. Potom
+ * sa zmeria počet hľadaní za sekundu pre rôzny počet čitateľov pri jednom
+ * zapisujúcom vlákne.
+ *
+ * Preklad spolu so súbormi zadania (btree.h, btree_util.c, stack.c):
+ *
+ *   cc -std=c11 -D_GNU_SOURCE -O2 -DBST_CONCURRENT [-DBST_BALANCED]
+ *      btree.c stack.c ../btree_util.c btree_concurrent_test.c -lpthread
+ *
+ * Pridaním -fsanitize=thread sa overia aj dátové súbehy. Program vráti 0,
+ * ak všetky kontroly prešli.
+ */
+
+#include "../btree.h"
+#include "../btree_ext.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef BST_CONCURRENT
+#error "Build the test with -DBST_CONCURRENT"
+#endif
+
+// Keys 0 to 31 are always present, the writers churn every other key
+#define STABLE_KEYS 32
+#define STRESS_WRITERS 2
+#define STRESS_READERS 3
+#define STRESS_WRITES 200000
+#define BENCH_WRITERS 1
+#define BENCH_MAX_READERS 8
+#define BENCH_MILLISECONDS 500
+
+typedef struct test_thread
+{
+	pthread_t thread;
+	unsigned seed;
+	// Each writer keeps the tree in its own pointer
+	bst_node_t *tree;
+	long operations;
+} test_thread_t;
+
+static bst_node_t *test_tree;
+static int test_stop = 0;
+static long test_failures = 0;
+
+static void test_fail(const char *message, int key)
+{
+	__atomic_fetch_add(&test_failures, 1, __ATOMIC_RELAXED);
+	fprintf(stderr, "FAIL: %s (key %d)\n", message, key);
+}
+
+static bool test_stable(int key)
+{
+	return key >= 0 && key < STABLE_KEYS;
+}
+
+static void *test_writer(void *argument)
+{
+	test_thread_t *self = argument;
+
+	for (long i = 0; i < STRESS_WRITES; i++)
+	{
+		if (__atomic_load_n(&test_stop, __ATOMIC_ACQUIRE))
+		{
+			break;
+		}
+
+		int key = rand_r(&self->seed) % 256 - 128;
+		if (test_stable(key))
+		{
+			continue;
+		}
+		if (rand_r(&self->seed) % 2 == 0)
+		{
+			bst_insert(&self->tree, (char)key, key * 3);
+		}
+		else
+		{
+			bst_delete(&self->tree, (char)key);
+		}
+		self->operations++;
+	}
+	return NULL;
+}
+
+static void *test_reader(void *argument)
+{
+	test_thread_t *self = argument;
+
+	while (!__atomic_load_n(&test_stop, __ATOMIC_ACQUIRE))
+	{
+		int key = rand_r(&self->seed) % 256 - 128;
+		int value = 0;
+		bst_node_t *tree = __atomic_load_n(&test_tree, __ATOMIC_ACQUIRE);
+		bool found = bst_search(tree, (char)key, &value);
+
+		if (test_stable(key) && !found)
+		{
+			test_fail("stable key not found", key);
+		}
+		if (found && value != key * 3)
+		{
+			test_fail("wrong value", key);
+		}
+		self->operations++;
+	}
+	return NULL;
+}
+
+static bool test_sorted_visit(bst_node_t *node, void *context)
+{
+	int *last = context;
+	if (node->key <= *last || node->value != node->key * 3)
+	{
+		test_fail("tree out of order after the stress run", node->key);
+	}
+	*last = node->key;
+	return true;
+}
+
+static double test_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Spustenie writers zapisujúcich vlákien a readers čitateľov nad stromom so
+ * stálymi kľúčmi. Ak milliseconds nie je 0, vlákna sa zastavia po tomto čase,
+ * inak keď zapisujúce vlákna dokončia STRESS_WRITES zápisov. Vráti počet
+ * hľadaní za sekundu.
+ */
+static double test_run(int writers, int readers, int milliseconds)
+{
+	test_thread_t threads[STRESS_WRITERS + BENCH_MAX_READERS] = {0};
+
+	bst_init(&test_tree);
+	for (int key = 0; key < STABLE_KEYS; key++)
+	{
+		bst_insert(&test_tree, (char)key, key * 3);
+	}
+	__atomic_store_n(&test_stop, 0, __ATOMIC_RELEASE);
+
+	double start = test_now();
+	for (int i = 0; i < writers + readers; i++)
+	{
+		threads[i].seed = (unsigned)i + 1;
+		threads[i].tree = test_tree;
+		pthread_create(&threads[i].thread, NULL,
+					   i < writers ? test_writer : test_reader, &threads[i]);
+	}
+
+	if (milliseconds > 0)
+	{
+		struct timespec pause = {.tv_sec = milliseconds / 1000,
+								 .tv_nsec = milliseconds % 1000 * 1000000L};
+		nanosleep(&pause, NULL);
+		__atomic_store_n(&test_stop, 1, __ATOMIC_RELEASE);
+	}
+	for (int i = 0; i < writers; i++)
+	{
+		pthread_join(threads[i].thread, NULL);
+	}
+	__atomic_store_n(&test_stop, 1, __ATOMIC_RELEASE);
+
+	long searches = 0;
+	for (int i = writers; i < writers + readers; i++)
+	{
+		pthread_join(threads[i].thread, NULL);
+		searches += threads[i].operations;
+	}
+	double elapsed = test_now() - start;
+
+	int last = -129;
+	bst_visit(test_tree, BST_INORDER, test_sorted_visit, &last);
+	for (int key = 0; key < STABLE_KEYS; key++)
+	{
+		int value;
+		if (!bst_search(test_tree, (char)key, &value))
+		{
+			test_fail("stable key lost", key);
+		}
+	}
+	bst_dispose(&test_tree);
+
+	return searches / elapsed;
+}
+
+int main(void)
+{
+	// A search from a tree pointer loaded before its root was deleted
+	bst_node_t *tree;
+	int value = 0;
+	bst_init(&tree);
+	bst_insert(&tree, 'a', 1);
+	bst_insert(&tree, 'b', 2);
+	bst_node_t *loaded = __atomic_load_n(&tree, __ATOMIC_ACQUIRE);
+	bst_delete(&tree, 'a');
+	if (bst_search(loaded, 'a', &value) || !bst_search(loaded, 'b', &value) ||
+		value != 2)
+	{
+		test_fail("search after the root was deleted", 'a');
+	}
+	bst_dispose(&tree);
+
+	test_run(STRESS_WRITERS, STRESS_READERS, 0);
+	printf("stress: %d writers, %d readers, %ld failures\n", STRESS_WRITERS,
+		   STRESS_READERS, test_failures);
+
+	for (int readers = 1; readers <= BENCH_MAX_READERS; readers *= 2)
+	{
+		double rate = test_run(BENCH_WRITERS, readers, BENCH_MILLISECONDS);
+		printf("bench: %d writer, %d readers, %.0f searches/s\n", BENCH_WRITERS,
+			   readers, rate);
+	}
+
+	return test_failures == 0 ? 0 : 1;
+}
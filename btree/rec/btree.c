@@ -6,8 +6,413 @@
  */
 
 #include "../btree.h"
+#include "../btree_ext.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// These modes exist only in the iterative variant
+#if defined(BST_CONCURRENT) || defined(BST_PARENT)
+#error "BST_CONCURRENT and BST_PARENT are iterative variant only"
+#endif
+
+/*
+ * Pomocné údaje uzlu.
+ *
+ * Typ bst_node_t je daný hlavičkovým súborom, preto sa údaje, ktoré
+ * potrebujú jednotlivé režimy, ukladajú pred uzol a uzly stromu sa v týchto
+ * režimoch alokujú výhradne ako bst_entry_t.
+ */
+#if defined(BST_BALANCED) || defined(BST_POOL) || defined(BST_PERSISTENT) || \
+	defined(BST_ORDER)
+#define BST_ENTRY_NODES
+
+typedef struct bst_entry
+{
+#ifdef BST_POOL
+	struct bst_pool *pool;
+#endif
+#ifdef BST_BALANCED
+	int height;
+#endif
+#ifdef BST_ORDER
+	// Number of nodes in the subtree rooted here
+	int size;
+#endif
+#ifdef BST_PERSISTENT
+	// Number of links and tree versions pointing to the node
+	int refs;
+#endif
+	bst_node_t node;
+} bst_entry_t;
+
+#define BST_ENTRY(node_ptr) \
+	((bst_entry_t *)((char *)(node_ptr) - offsetof(bst_entry_t, node)))
+#endif
+
+/*
+ * Režim trvalých verzií, zapína sa prekladom s -DBST_PERSISTENT.
+ *
+ * Funkcia bst_share vytvorí novú verziu stromu v čase O(1). Verzie zdieľajú
+ * uzly a každý uzol si pamätá počet odkazov naň. bst_insert, bst_delete
+ * a vyvažovanie pred zmenou zdieľaného uzlu nahradia uzol jeho kópiou, takže
+ * sa skopírujú iba uzly na ceste od koreňa a ostatné verzie sa nezmenia.
+ * bst_dispose uvoľní iba uzly, na ktoré už neodkazuje iná verzia. Počty
+ * odkazov sa menia atomicky, aby verzie mohli rušiť aj iné vlákna.
+ */
+static bool bst_unshare(bst_node_t **link);
+
+/*
+ * Poradové štatistiky, zapínajú sa prekladom s -DBST_ORDER.
+ *
+ * Každý uzol si pamätá veľkosť svojho podstromu, ktorú zápisy obnovujú na
+ * ceste od zmeneného miesta ku koreňu. Na nej stoja bst_rank, bst_select
+ * a bst_count_range s časom O(h).
+ */
+#ifdef BST_ORDER
+static int bst_subtree_size(bst_node_t *tree)
+{
+	return tree != NULL ? BST_ENTRY(tree)->size : 0;
+}
+
+static void bst_update_size(bst_node_t *tree)
+{
+	BST_ENTRY(tree)->size =
+		bst_subtree_size(tree->left) + bst_subtree_size(tree->right) + 1;
+}
+#endif
+
+// Writers repair node data on the way back up in these modes
+#if defined(BST_BALANCED) || defined(BST_ORDER)
+#define BST_REPAIR_PATHS
+#endif
+
+/*
+ * Vyvážený režim (AVL), zapína sa prekladom s -DBST_BALANCED.
+ *
+ * Rozhranie bst_* sa nemení, strom sa vyvažuje pri vkladaní aj mazaní.
+ */
+#ifdef BST_BALANCED
+static int bst_height(bst_node_t *tree)
+{
+	return tree != NULL ? BST_ENTRY(tree)->height : 0;
+}
+
+static void bst_update_height(bst_node_t *tree)
+{
+	int left = bst_height(tree->left);
+	int right = bst_height(tree->right);
+	BST_ENTRY(tree)->height = (left > right ? left : right) + 1;
+}
+
+// Left child becomes the root of the subtree
+static void bst_rotate_right(bst_node_t **tree)
+{
+	// Malloc fail while copying nodes shared with another version
+	if (!bst_unshare(tree) || !bst_unshare(&(*tree)->left))
+	{
+		return;
+	}
+
+	bst_node_t *left = (*tree)->left;
+	(*tree)->left = left->right;
+	left->right = *tree;
+	bst_update_height(*tree);
+	bst_update_height(left);
+#ifdef BST_ORDER
+	bst_update_size(*tree);
+	bst_update_size(left);
+#endif
+	*tree = left;
+}
+
+// Right child becomes the root of the subtree
+static void bst_rotate_left(bst_node_t **tree)
+{
+	// Malloc fail while copying nodes shared with another version
+	if (!bst_unshare(tree) || !bst_unshare(&(*tree)->right))
+	{
+		return;
+	}
+
+	bst_node_t *right = (*tree)->right;
+	(*tree)->right = right->left;
+	right->left = *tree;
+	bst_update_height(*tree);
+	bst_update_height(right);
+#ifdef BST_ORDER
+	bst_update_size(*tree);
+	bst_update_size(right);
+#endif
+	*tree = right;
+}
+
+/*
+ * Obnovenie výšky a vyváženosti uzlu, ktorého podstromy sú už vyvážené.
+ */
+static void bst_balance(bst_node_t **tree)
+{
+	if (*tree == NULL)
+	{
+		return;
+	}
+
+	int balance = bst_height((*tree)->left) - bst_height((*tree)->right);
+
+	// Left subtree is too high
+	if (balance > 1)
+	{
+		if (bst_height((*tree)->left->left) < bst_height((*tree)->left->right))
+		{
+			bst_rotate_left(&(*tree)->left);
+		}
+		bst_rotate_right(tree);
+	}
+	// Right subtree is too high
+	else if (balance < -1)
+	{
+		if (bst_height((*tree)->right->right) < bst_height((*tree)->right->left))
+		{
+			bst_rotate_right(&(*tree)->right);
+		}
+		bst_rotate_left(tree);
+	}
+	else
+	{
+		bst_update_height(*tree);
+	}
+}
+#endif
+
+#ifdef BST_REPAIR_PATHS
+/*
+ * Obnovenie veľkosti podstromu, výšky a vyváženosti uzlu po zmene jeho
+ * podstromov.
+ */
+static void bst_repair(bst_node_t **tree)
+{
+	if (*tree == NULL)
+	{
+		return;
+	}
+#ifdef BST_ORDER
+	bst_update_size(*tree);
+#endif
+#ifdef BST_BALANCED
+	bst_balance(tree);
+#endif
+}
+#endif
+
+// Node pools, shared by both variants
+#include "../btree_pool.h"
+
+/*
+ * Alokácia nového listového uzlu.
+ *
+ * Parameter neighbour je uzol stromu, do ktorého sa nový uzol vkladá, alebo
+ * NULL, ak je strom prázdny. V režime BST_POOL sa nový uzol berie z jeho
+ * zásobárne a prázdny strom dostane novú zásobáreň s miestom pre count uzlov.
+ */
+static bst_node_t *bst_node_new_sized(bst_node_t *neighbour, int count,
+									  char key, int value)
+{
+	bst_node_t *node;
+
+#ifdef BST_ENTRY_NODES
+	bst_entry_t *entry;
+#ifdef BST_POOL
+	// Empty tree gets its own pool
+	bst_pool_t *pool = neighbour != NULL ? BST_ENTRY(neighbour)->pool
+										 : bst_pool_new(count);
+	// Malloc fail
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+	entry = bst_pool_alloc(pool);
+	// Malloc fail, drop the pool if it was just created
+	if (entry == NULL)
+	{
+		if (pool->live == 0)
+		{
+			bst_pool_release(pool);
+		}
+		return NULL;
+	}
+#else
+	(void)neighbour;
+	(void)count;
+	entry = malloc(sizeof(bst_entry_t));
+	// Malloc fail
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+#endif
+#ifdef BST_BALANCED
+	entry->height = 1;
+#endif
+#ifdef BST_ORDER
+	entry->size = 1;
+#endif
+#ifdef BST_PERSISTENT
+	entry->refs = 1;
+#endif
+	node = &entry->node;
+#else
+	(void)neighbour;
+	(void)count;
+	node = malloc(sizeof(bst_node_t));
+	// Malloc fail
+	if (node == NULL)
+	{
+		return NULL;
+	}
+#endif
+	node->key = key;
+	node->value = value;
+	node->left = NULL;
+	node->right = NULL;
+	return node;
+}
+
+static bst_node_t *bst_node_new(bst_node_t *neighbour, char key, int value)
+{
+	return bst_node_new_sized(neighbour, 0, key, value);
+}
+
+/*
+ * Uvoľnenie uzlu alokovaného pomocou bst_node_new.
+ */
+static void bst_node_free(bst_node_t *node)
+{
+#ifdef BST_POOL
+	bst_pool_t *pool = BST_ENTRY(node)->pool;
+
+	// Return the node to the free list, the last node takes the pool along
+	node->left = pool->free_nodes;
+	pool->free_nodes = node;
+	if (--pool->live == 0)
+	{
+		bst_pool_release(pool);
+	}
+#elif defined(BST_ENTRY_NODES)
+	free(BST_ENTRY(node));
+#else
+	free(node);
+#endif
+}
+
+#ifdef BST_PERSISTENT
+/*
+ * Pridanie odkazu na uzol.
+ */
+static void bst_node_ref(bst_node_t *node)
+{
+	__atomic_fetch_add(&BST_ENTRY(node)->refs, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+/*
+ * Odobratie jedného odkazu na uzol. Vráti true, ak to bol posledný odkaz
+ * a uzol sa má uvoľniť.
+ */
+static bool bst_node_unref(bst_node_t *node)
+{
+#ifdef BST_PERSISTENT
+	return __atomic_sub_fetch(&BST_ENTRY(node)->refs, 1, __ATOMIC_ACQ_REL) == 0;
+#else
+	(void)node;
+	return true;
+#endif
+}
+
+/*
+ * Nahradenie uzlu, na ktorý ukazuje link, jeho kópiou, ak naň odkazuje aj
+ * iná verzia stromu. Pri chybe alokácie vráti false.
+ */
+static bool bst_unshare(bst_node_t **link)
+{
+#ifdef BST_PERSISTENT
+	bst_node_t *node = *link;
+
+	// A sole owner sees every release of the other versions
+	if (node == NULL ||
+		__atomic_load_n(&BST_ENTRY(node)->refs, __ATOMIC_ACQUIRE) == 1)
+	{
+		return true;
+	}
+
+	bst_node_t *copy = bst_node_new(node, node->key, node->value);
+	// Malloc fail
+	if (copy == NULL)
+	{
+		return false;
+	}
+
+	// The copy adds a second link to both children
+	copy->left = node->left;
+	copy->right = node->right;
+	if (copy->left != NULL)
+	{
+		bst_node_ref(copy->left);
+	}
+	if (copy->right != NULL)
+	{
+		bst_node_ref(copy->right);
+	}
+#ifdef BST_BALANCED
+	BST_ENTRY(copy)->height = BST_ENTRY(node)->height;
+#endif
+#ifdef BST_ORDER
+	BST_ENTRY(copy)->size = BST_ENTRY(node)->size;
+#endif
+
+	*link = copy;
+
+	// Every other version was disposed meanwhile, the old node is unused
+	if (bst_node_unref(node))
+	{
+		// The copy still holds both children
+		if (node->left != NULL)
+		{
+			bst_node_unref(node->left);
+		}
+		if (node->right != NULL)
+		{
+			bst_node_unref(node->right);
+		}
+		bst_node_free(node);
+	}
+#else
+	(void)link;
+#endif
+	return true;
+}
+
+/*
+ * Uvoľnenie celého stromu naraz, ak to režim alokácie umožňuje.
+ *
+ * Vráti true, ak bol strom uvoľnený a ukazovateľ nastavený na NULL.
+ */
+static bool bst_dispose_all(bst_node_t **tree)
+{
+	// Other versions may still use nodes of the pool
+#if defined(BST_POOL) && !defined(BST_PERSISTENT)
+	// The whole pool belongs to this tree
+	if (*tree != NULL)
+	{
+		bst_pool_release(BST_ENTRY(*tree)->pool);
+		*tree = NULL;
+		return true;
+	}
+#else
+	(void)tree;
+#endif
+	return false;
+}
 
 /*
  * Inicializácia stromu.
@@ -71,18 +476,14 @@ void bst_insert(bst_node_t **tree, char key, int value)
 	// If tree is empty, create new node
 	if (*tree == NULL)
 	{
-		// Allocate needed space
-		*tree = malloc(sizeof(bst_node_t));
-		// Malloc fail
-		if (*tree == NULL)
-		{
-			return;
-		}
-		// Insert data
-		(*tree)->key = key;
-		(*tree)->value = value;
-		(*tree)->left = NULL;
-		(*tree)->right = NULL;
+		// Allocate needed space and insert data, stays NULL on malloc fail
+		*tree = bst_node_new(NULL, key, value);
+		return;
+	}
+
+	// Malloc fail while copying a node shared with another version
+	if (!bst_unshare(tree))
+	{
 		return;
 	}
 
@@ -95,10 +496,26 @@ void bst_insert(bst_node_t **tree, char key, int value)
 
 	// If current node key is bigger than given key, insert in left subtree
 	if ((*tree)->key > key)
-		bst_insert(&(*tree)->left, key, value);
+	{
+		// A new leaf is allocated next to its parent
+		if ((*tree)->left == NULL)
+			(*tree)->left = bst_node_new(*tree, key, value);
+		else
+			bst_insert(&(*tree)->left, key, value);
+	}
 	// Otherwise, insert in right subtree
 	else
-		bst_insert(&(*tree)->right, key, value);
+	{
+		if ((*tree)->right == NULL)
+			(*tree)->right = bst_node_new(*tree, key, value);
+		else
+			bst_insert(&(*tree)->right, key, value);
+	}
+
+#ifdef BST_REPAIR_PATHS
+	// Restore sizes and balance on the way back up
+	bst_repair(tree);
+#endif
 }
 
 /*
@@ -108,6 +525,12 @@ void bst_insert(bst_node_t **tree, char key, int value)
  */
 void bst_replace_by_rightmost(bst_node_t *target, bst_node_t **tree)
 {
+	// Malloc fail while copying a node shared with another version
+	if (!bst_unshare(tree))
+	{
+		return;
+	}
+
 	// If right subtree is empty, replace target with current node
 	if ((*tree)->right == NULL)
 	{
@@ -119,12 +542,17 @@ void bst_replace_by_rightmost(bst_node_t *target, bst_node_t **tree)
 		// Replace current node with left subtree
 		*tree = (*tree)->left;
 		// Free memory
-		free(tmp);
+		bst_node_free(tmp);
 		return;
 	}
 
 	// Otherwise, search right subtree
 	bst_replace_by_rightmost(target, &(*tree)->right);
+
+#ifdef BST_REPAIR_PATHS
+	// Restore sizes and balance on the way back up
+	bst_repair(tree);
+#endif
 }
 
 /*
@@ -147,13 +575,19 @@ void bst_delete(bst_node_t **tree, char key)
 		return;
 	}
 
+	// Malloc fail while copying a node shared with another version
+	if (!bst_unshare(tree))
+	{
+		return;
+	}
+
 	// If current node key is same as given key, delete node
 	if ((*tree)->key == key)
 	{
 		// If node has no children, delete it
 		if ((*tree)->left == NULL && (*tree)->right == NULL)
 		{
-			free(*tree);
+			bst_node_free(*tree);
 			*tree = NULL;
 			return;
 		}
@@ -162,27 +596,30 @@ void bst_delete(bst_node_t **tree, char key)
 		{
 			bst_node_t *tmp = *tree;
 			*tree = (*tree)->right;
-			free(tmp);
+			bst_node_free(tmp);
 			return;
 		}
 		if ((*tree)->right == NULL)
 		{
 			bst_node_t *tmp = *tree;
 			*tree = (*tree)->left;
-			free(tmp);
+			bst_node_free(tmp);
 			return;
 		}
 		// If node has two children, replace it with rightmost node in left subtree
 		bst_replace_by_rightmost(*tree, &(*tree)->left);
-		return;
 	}
-
 	// If current node key is bigger than given key, delete in left subtree
-	if ((*tree)->key > key)
+	else if ((*tree)->key > key)
 		bst_delete(&(*tree)->left, key);
 	// Otherwise, delete in right subtree
 	else
 		bst_delete(&(*tree)->right, key);
+
+#ifdef BST_REPAIR_PATHS
+	// Restore sizes and balance on the way back up
+	bst_repair(tree);
+#endif
 }
 
 /*
@@ -202,12 +639,25 @@ void bst_dispose(bst_node_t **tree)
 		return;
 	}
 
+	// Pooled trees are released in one step
+	if (bst_dispose_all(tree))
+	{
+		return;
+	}
+
+	// Nodes still used by another version stay allocated
+	if (!bst_node_unref(*tree))
+	{
+		*tree = NULL;
+		return;
+	}
+
 	// Delete both subtrees
 	bst_dispose(&(*tree)->left);
 	bst_dispose(&(*tree)->right);
 
 	// Delete current node
-	free(*tree);
+	bst_node_free(*tree);
 	*tree = NULL;
 }
 
@@ -268,3 +718,115 @@ void bst_postorder(bst_node_t *tree)
 	bst_postorder(tree->right);
 	bst_print_node(tree);
 }
+
+/*
+ * Prechod stromom v poradí order, ktorý pre každý uzol zavolá visit.
+ *
+ * Vráti true, ak prechod prešiel celý strom, false ak ho visit ukončil.
+ */
+bool bst_visit(bst_node_t *tree, bst_order_t order, bst_visitor_t visit,
+			   void *context)
+{
+	if (tree == NULL)
+	{
+		return true;
+	}
+
+	// Stop as soon as the visitor asks to
+	if (order == BST_PREORDER && !visit(tree, context))
+	{
+		return false;
+	}
+	if (!bst_visit(tree->left, order, visit, context))
+	{
+		return false;
+	}
+	if (order == BST_INORDER && !visit(tree, context))
+	{
+		return false;
+	}
+	if (!bst_visit(tree->right, order, visit, context))
+	{
+		return false;
+	}
+	if (order == BST_POSTORDER && !visit(tree, context))
+	{
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Vytvorenie dokonale vyváženého podstromu z count usporiadaných kľúčov.
+ *
+ * Parameter neighbour je rodič vytváraného podstromu alebo NULL pre koreň.
+ * Pri chybe alokácie vráti false, už vytvorené uzly zostávajú v strome.
+ */
+static bool bst_build_subtree(bst_node_t **tree, bst_node_t *neighbour,
+							  const char *keys, const int *values, int count)
+{
+	if (count <= 0)
+	{
+		return true;
+	}
+
+	// Middle key becomes the root, the halves form its subtrees
+	int middle = count / 2;
+	*tree = bst_node_new_sized(neighbour, count, keys[middle], values[middle]);
+	// Malloc fail
+	if (*tree == NULL)
+	{
+		return false;
+	}
+
+	if (!bst_build_subtree(&(*tree)->left, *tree, keys, values, middle) ||
+		!bst_build_subtree(&(*tree)->right, *tree, keys + middle + 1,
+						   values + middle + 1, count - middle - 1))
+	{
+		return false;
+	}
+
+#ifdef BST_BALANCED
+	bst_update_height(*tree);
+#endif
+#ifdef BST_ORDER
+	bst_update_size(*tree);
+#endif
+	return true;
+}
+
+static bool bst_build_range(bst_node_t **tree, const char *keys,
+							const int *values, int count)
+{
+	return bst_build_subtree(tree, NULL, keys, values, count);
+}
+
+/*
+ * Strom nemá hlavičku, tú používa iba súbežný režim iteratívnej varianty,
+ * a *tree je priamo koreň.
+ */
+static inline bst_node_t *bst_root(bst_node_t *tree)
+{
+	return tree;
+}
+
+static inline bst_node_t **bst_root_link(bst_node_t **tree)
+{
+	return tree;
+}
+
+static inline bool bst_header_attach(bst_node_t **tree)
+{
+	(void)tree;
+	return true;
+}
+
+static inline void bst_header_dispose(bst_node_t **tree)
+{
+	(void)tree;
+}
+
+/*
+ * Rozšírenia spoločné pre obe varianty.
+ */
+#include "../btree_shared.h"
@@ -9,11 +9,708 @@
  */
 
 #include "hashtable.h"
+#include "hashtable_ext.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HT_CONCURRENT
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef HT_IMAGE
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 int HT_SIZE = MAX_HT_SIZE;
 
+/*
+ * Výber rozptyľovacej funkcie pri preklade (-DHT_HASH=...), aby bolo možné
+ * jednotlivé funkcie medzi sebou porovnať.
+ */
+#define HT_HASH_SUM 0
+#define HT_HASH_FNV1A 1
+#define HT_HASH_WY 2
+
+#ifndef HT_HASH
+#ifdef __SIZEOF_INT128__
+#define HT_HASH HT_HASH_WY
+#else
+#define HT_HASH HT_HASH_FNV1A
+#endif
+#endif
+
+/*
+ * Položka tabuľky spolu s úplnou hodnotou rozptyľovacej funkcie jej kľúča.
+ *
+ * Typ ht_item_t je daný hlavičkovým súborom, preto sa hash ukladá pred
+ * položku a položky tabuľky sa alokujú výhradne ako ht_entry_t. Tabuľka si
+ * kľúč kopíruje, krátke kľúče (menej ako HT_INLINE_KEY znakov) ležia priamo
+ * za položkou, takže porovnanie kľúča väčšinou nesiahne mimo uzlu.
+ */
+#ifndef HT_INLINE_KEY
+#define HT_INLINE_KEY 32
+#endif
+
+typedef struct ht_entry
+{
+	uint64_t hash;
+	ht_item_t item;
+#ifdef HT_CONCURRENT
+	struct ht_entry *retired;
+#endif
+#ifdef HT_SLAB
+	struct ht_arena *arena;
+#endif
+	char key[HT_INLINE_KEY];
+} ht_entry_t;
+
+#define HT_ENTRY(item_ptr) \
+	((ht_entry_t *)((char *)(item_ptr) - offsetof(ht_entry_t, item)))
+
+/*
+ * Alokátor položiek po blokoch (slab), zapína sa prekladom s -DHT_SLAB.
+ *
+ * Každá tabuľka má vlastnú arénu. Položky sa berú z blokov po HT_SLAB_ITEMS
+ * kusoch, dlhé kľúče z blokov reťazcov v miestach veľkosti mocniny dvoch.
+ * Uvoľnené položky aj miesta kľúčov sa vracajú do zoznamov voľných miest
+ * svojej arény a ďalšie vkladanie ich použije znova.
+ *
+ * Typ ht_table_t je daný hlavičkovým súborom, preto sa aréna tabuľky hľadá
+ * v pomocnej tabuľke podľa adresy tabuľky a tabuľka sa v tomto režime nesmie
+ * presúvať v pamäti. Každá položka si pamätá svoju arénu. Bez -DHT_CONCURRENT
+ * ht_delete_all uvoľní celú arénu naraz bez prechodu zoznamov. V súbežnom
+ * režime môžu čitatelia ešte prechádzať odpojené zoznamy, položky sa preto
+ * vracajú po jednej a aréna sa uvoľní spolu s poslednou z nich.
+ */
+#ifdef HT_SLAB
+#ifndef HT_SLAB_ITEMS
+#define HT_SLAB_ITEMS 256
+#endif
+#ifndef HT_KEY_BLOCK
+#define HT_KEY_BLOCK 4096
+#endif
+
+// Key slots are 64 << class bytes
+#define HT_KEY_CLASS_MIN 64
+#define HT_KEY_CLASSES 32
+
+// Buckets of the table address to arena map
+#define HT_ARENAS 64
+
+typedef struct ht_slab
+{
+	struct ht_slab *next;
+	ht_entry_t entries[HT_SLAB_ITEMS];
+} ht_slab_t;
+
+typedef struct ht_key_block
+{
+	struct ht_key_block *next;
+	size_t used;
+	size_t size;
+	char data[];
+} ht_key_block_t;
+
+typedef struct ht_arena
+{
+	// Owning table, NULL once ht_delete_all has detached the arena
+	ht_table_t *table;
+	struct ht_arena *next;
+	ht_slab_t *slabs;
+	int slab_used;
+	ht_entry_t *free_entries;
+	size_t live_entries;
+	ht_key_block_t *key_blocks;
+	char *free_keys[HT_KEY_CLASSES];
+} ht_arena_t;
+
+static ht_arena_t *ht_arenas[HT_ARENAS];
+
+#ifdef HT_CONCURRENT
+static pthread_mutex_t ht_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ * Odkaz na arénu tabuľky v pomocnej tabuľke, pri chýbajúcej aréne odkaz na
+ * NULL na konci zoznamu.
+ */
+static ht_arena_t **ht_arena_link(ht_table_t *table)
+{
+	ht_arena_t **link = &ht_arenas[((uintptr_t)table >> 4) % HT_ARENAS];
+	while (*link != NULL && (*link)->table != table)
+	{
+		link = &(*link)->next;
+	}
+	return link;
+}
+
+/*
+ * Aréna tabuľky, pri prvom použití sa vytvorí. Pri chybe alokácie vráti NULL.
+ */
+static ht_arena_t *ht_arena_get(ht_table_t *table)
+{
+	ht_arena_t **link = ht_arena_link(table);
+	if (*link != NULL)
+	{
+		return *link;
+	}
+
+	ht_arena_t *arena = calloc(1, sizeof(ht_arena_t));
+	// Malloc fail
+	if (arena == NULL)
+	{
+		return NULL;
+	}
+	arena->table = table;
+	arena->slab_used = HT_SLAB_ITEMS;
+	*link = arena;
+	return arena;
+}
+
+/*
+ * Uvoľnenie arény so všetkými jej blokmi naraz.
+ */
+static void ht_arena_free(ht_arena_t *arena)
+{
+	// Detached arenas are no longer in the map
+	if (arena->table != NULL)
+	{
+		*ht_arena_link(arena->table) = arena->next;
+	}
+
+	while (arena->slabs != NULL)
+	{
+		ht_slab_t *slab = arena->slabs->next;
+		free(arena->slabs);
+		arena->slabs = slab;
+	}
+	while (arena->key_blocks != NULL)
+	{
+		ht_key_block_t *block = arena->key_blocks->next;
+		free(arena->key_blocks);
+		arena->key_blocks = block;
+	}
+	free(arena);
+}
+
+/*
+ * Trieda miesta v aréne reťazcov pre kľúč s size bajtami.
+ */
+static int ht_key_class(size_t size)
+{
+	int class = 0;
+	while ((size_t)HT_KEY_CLASS_MIN << class < size)
+	{
+		class++;
+	}
+	return class;
+}
+
+/*
+ * Miesto pre dlhý kľúč v aréne reťazcov.
+ */
+static char *ht_key_alloc(ht_arena_t *arena, size_t size)
+{
+	int class = ht_key_class(size);
+
+	// Reuse a slot freed by a deleted key of the same class first
+	if (arena->free_keys[class] != NULL)
+	{
+		char *result = arena->free_keys[class];
+		memcpy(&arena->free_keys[class], result, sizeof(char *));
+		return result;
+	}
+
+	// Current block is full, start a new one
+	size = (size_t)HT_KEY_CLASS_MIN << class;
+	if (arena->key_blocks == NULL ||
+		arena->key_blocks->size - arena->key_blocks->used < size)
+	{
+		size_t block_size = size > HT_KEY_BLOCK ? size : HT_KEY_BLOCK;
+		ht_key_block_t *block = malloc(sizeof(ht_key_block_t) + block_size);
+		// Malloc fail
+		if (block == NULL)
+		{
+			return NULL;
+		}
+		block->next = arena->key_blocks;
+		block->used = 0;
+		block->size = block_size;
+		arena->key_blocks = block;
+	}
+
+	char *result = arena->key_blocks->data + arena->key_blocks->used;
+	arena->key_blocks->used += size;
+	return result;
+}
+
+/*
+ * Vrátenie miesta dlhého kľúča s size bajtami do zoznamu voľných miest.
+ */
+static void ht_key_free(ht_arena_t *arena, char *key, size_t size)
+{
+	int class = ht_key_class(size);
+
+	// The free list link is kept in the slot itself
+	memcpy(key, &arena->free_keys[class], sizeof(char *));
+	arena->free_keys[class] = key;
+}
+#endif
+
+/*
+ * Alokácia jednej položky tabuľky table s kópiou kľúča dĺžky length.
+ */
+static ht_entry_t *ht_entry_new(ht_table_t *table, const char *key,
+								size_t length, uint64_t hash)
+{
+	ht_entry_t *entry = NULL;
+
+#ifdef HT_SLAB
+	char *long_key = NULL;
+
+#ifdef HT_CONCURRENT
+	pthread_mutex_lock(&ht_slab_lock);
+#endif
+
+	ht_arena_t *arena = ht_arena_get(table);
+	// Malloc fail
+	if (arena == NULL)
+	{
+		goto unlock;
+	}
+
+	// Long keys go to the key arena
+	if (length >= HT_INLINE_KEY)
+	{
+		long_key = ht_key_alloc(arena, length + 1);
+		// Malloc fail
+		if (long_key == NULL)
+		{
+			goto unlock;
+		}
+	}
+
+	// Reuse a previously deleted entry first
+	if (arena->free_entries != NULL)
+	{
+		entry = arena->free_entries;
+		arena->free_entries = entry->item.next != NULL
+								  ? HT_ENTRY(entry->item.next)
+								  : NULL;
+	}
+	else
+	{
+		// Current slab is full, start a new one
+		if (arena->slab_used == HT_SLAB_ITEMS)
+		{
+			ht_slab_t *slab = malloc(sizeof(ht_slab_t));
+			// Malloc fail
+			if (slab == NULL)
+			{
+				if (long_key != NULL)
+				{
+					ht_key_free(arena, long_key, length + 1);
+				}
+				goto unlock;
+			}
+			slab->next = arena->slabs;
+			arena->slabs = slab;
+			arena->slab_used = 0;
+		}
+		entry = &arena->slabs->entries[arena->slab_used++];
+	}
+
+	arena->live_entries++;
+	entry->arena = arena;
+	entry->item.key = long_key != NULL ? long_key : entry->key;
+
+unlock:
+#ifdef HT_CONCURRENT
+	pthread_mutex_unlock(&ht_slab_lock);
+#endif
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+#else
+	(void)table;
+
+	// Long keys extend the entry past its inline buffer
+	size_t size = sizeof(ht_entry_t);
+	if (length >= HT_INLINE_KEY)
+	{
+		size = offsetof(ht_entry_t, key) + length + 1;
+	}
+
+	entry = malloc(size);
+	// Malloc fail
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+	entry->item.key = entry->key;
+#endif
+
+	entry->hash = hash;
+	memcpy(entry->item.key, key, length + 1);
+	return entry;
+}
+
+/*
+ * Uvoľnenie zoznamu položiek spojeného cez next.
+ */
+static void ht_entry_release(ht_item_t *item)
+{
+	ht_item_t *next;
+
+#if defined(HT_SLAB) && defined(HT_CONCURRENT)
+	pthread_mutex_lock(&ht_slab_lock);
+#endif
+
+	while (item != NULL)
+	{
+		next = item->next;
+#ifdef HT_SLAB
+		ht_arena_t *arena = HT_ENTRY(item)->arena;
+
+		// Long key slots are recycled by size class
+		if (item->key != HT_ENTRY(item)->key)
+		{
+			ht_key_free(arena, item->key, strlen(item->key) + 1);
+		}
+		// Return the entry to its arena instead of the allocator
+		item->next =
+			arena->free_entries != NULL ? &arena->free_entries->item : NULL;
+		arena->free_entries = HT_ENTRY(item);
+		arena->live_entries--;
+
+		// A detached arena goes away with its last entry
+		if (arena->table == NULL && arena->live_entries == 0)
+		{
+			ht_arena_free(arena);
+		}
+#else
+		free(HT_ENTRY(item));
+#endif
+		item = next;
+	}
+
+#if defined(HT_SLAB) && defined(HT_CONCURRENT)
+	pthread_mutex_unlock(&ht_slab_lock);
+#endif
+}
+
+/*
+ * Súbežný režim, zapína sa prekladom s -DHT_CONCURRENT.
+ *
+ * Čítanie (ht_search, ht_get, ht_get_batch) nepoužíva zámky, zápis zamyká
+ * jeden z HT_STRIPES zámkov podľa indexu zoznamu. Odstránené položky sa
+ * uvoľňujú až po uplynutí dvoch epoch, keď ich už žiadny čitateľ nemôže
+ * držať (epoch-based reclamation).
+ *
+ * Ukazovateľ vrátený z ht_search alebo ht_get zostáva platný, kým niektoré
+ * vlákno daný kľúč nezmaže.
+ */
+#ifdef HT_CONCURRENT
+#ifndef HT_STRIPES
+#define HT_STRIPES 64
+#endif
+#ifndef HT_MAX_THREADS
+#define HT_MAX_THREADS 256
+#endif
+
+#define HT_LOAD(location) __atomic_load_n(&(location), __ATOMIC_ACQUIRE)
+#define HT_PUBLISH(location, value) \
+	__atomic_store_n(&(location), (value), __ATOMIC_RELEASE)
+#define HT_SET_VALUE(item, new_value) \
+	__atomic_store(&(item)->value, &(new_value), __ATOMIC_RELAXED)
+
+// Reader state, (epoch << 1) | 1 while inside a read, 0 otherwise
+typedef struct ht_reader
+{
+	unsigned long state;
+	int in_use;
+	char padding[64 - sizeof(unsigned long) - sizeof(int)];
+} ht_reader_t;
+
+static ht_reader_t ht_readers[HT_MAX_THREADS];
+static int ht_readers_high = 0;
+static _Thread_local ht_reader_t *ht_reader = NULL;
+static pthread_key_t ht_reader_key;
+
+static pthread_mutex_t ht_stripes[HT_STRIPES];
+static pthread_once_t ht_once = PTHREAD_ONCE_INIT;
+
+static unsigned long ht_epoch = 0;
+static ht_entry_t *ht_limbo[3];
+static pthread_mutex_t ht_limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Give the reader slot back when its thread exits
+static void ht_reader_exit(void *reader)
+{
+	__atomic_store_n(&((ht_reader_t *)reader)->state, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&((ht_reader_t *)reader)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void ht_concurrent_init(void)
+{
+	for (int i = 0; i < HT_STRIPES; i++)
+	{
+		pthread_mutex_init(&ht_stripes[i], NULL);
+	}
+	pthread_key_create(&ht_reader_key, ht_reader_exit);
+}
+
+/*
+ * Začiatok čítania, vlákno ohlási epochu, ktorú práve vidí.
+ */
+static void ht_read_begin(void)
+{
+	// Claim a reader slot on the first read of this thread
+	while (ht_reader == NULL)
+	{
+		pthread_once(&ht_once, ht_concurrent_init);
+		for (int i = 0; i < HT_MAX_THREADS; i++)
+		{
+			int expected = 0;
+			if (__atomic_compare_exchange_n(&ht_readers[i].in_use, &expected, 1,
+											false, __ATOMIC_ACQ_REL,
+											__ATOMIC_RELAXED))
+			{
+				ht_reader = &ht_readers[i];
+				pthread_setspecific(ht_reader_key, ht_reader);
+
+				// Remember the highest slot ever used to bound the scans
+				int high = __atomic_load_n(&ht_readers_high, __ATOMIC_RELAXED);
+				while (high < i + 1 &&
+					   !__atomic_compare_exchange_n(&ht_readers_high, &high, i + 1,
+													true, __ATOMIC_RELEASE,
+													__ATOMIC_RELAXED))
+				{
+				}
+				break;
+			}
+		}
+		// All slots taken, wait for a thread to exit
+		if (ht_reader == NULL)
+		{
+			sched_yield();
+		}
+	}
+
+	unsigned long epoch = __atomic_load_n(&ht_epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&ht_reader->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Koniec čítania.
+ */
+static void ht_read_end(void)
+{
+	__atomic_store_n(&ht_reader->state, 0, __ATOMIC_RELEASE);
+}
+
+static void ht_write_lock(int index)
+{
+	pthread_once(&ht_once, ht_concurrent_init);
+	pthread_mutex_lock(&ht_stripes[index % HT_STRIPES]);
+}
+
+static void ht_write_unlock(int index)
+{
+	pthread_mutex_unlock(&ht_stripes[index % HT_STRIPES]);
+}
+
+/*
+ * Odloženie uvoľnenia položiek od item po end (bez end) odpojených od
+ * tabuľky.
+ *
+ * Ukazovatele next sa nemenia, lebo po zozname ešte môžu prechádzať
+ * čitatelia. Položky sa uvoľnia, keď sa epocha posunie o dve.
+ */
+static void ht_retire(ht_item_t *item, ht_item_t *end)
+{
+	ht_item_t *reclaim = NULL;
+
+	pthread_mutex_lock(&ht_limbo_lock);
+
+	unsigned long epoch = __atomic_load_n(&ht_epoch, __ATOMIC_SEQ_CST);
+	for (; item != end; item = item->next)
+	{
+		HT_ENTRY(item)->retired = ht_limbo[epoch % 3];
+		ht_limbo[epoch % 3] = HT_ENTRY(item);
+	}
+
+	// Advance the epoch once every active reader has seen the current one
+	int high = __atomic_load_n(&ht_readers_high, __ATOMIC_ACQUIRE);
+	bool quiescent = true;
+	for (int i = 0; i < high && quiescent; i++)
+	{
+		unsigned long state = __atomic_load_n(&ht_readers[i].state,
+											  __ATOMIC_SEQ_CST);
+		quiescent = (state & 1) == 0 || (state >> 1) == epoch;
+	}
+
+	if (quiescent)
+	{
+		__atomic_store_n(&ht_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+
+		// Entries retired two epochs ago are unreachable now
+		ht_entry_t *entry = ht_limbo[(epoch + 2) % 3];
+		ht_limbo[(epoch + 2) % 3] = NULL;
+		while (entry != NULL)
+		{
+			ht_entry_t *retired = entry->retired;
+			entry->item.next = reclaim;
+			reclaim = &entry->item;
+			entry = retired;
+		}
+	}
+
+	pthread_mutex_unlock(&ht_limbo_lock);
+
+	ht_entry_release(reclaim);
+}
+#else
+#define HT_LOAD(location) (location)
+#define HT_PUBLISH(location, value) ((location) = (value))
+#define HT_SET_VALUE(item, new_value) ((item)->value = (new_value))
+
+static inline void ht_read_begin(void)
+{
+}
+
+static inline void ht_read_end(void)
+{
+}
+
+static inline void ht_write_lock(int index)
+{
+	(void)index;
+}
+
+static inline void ht_write_unlock(int index)
+{
+	(void)index;
+}
+
+static inline void ht_retire(ht_item_t *item, ht_item_t *end)
+{
+	// Cut the released part off the rest of the list
+	if (end != NULL)
+	{
+		ht_item_t *last = item;
+		while (last->next != end)
+		{
+			last = last->next;
+		}
+		last->next = NULL;
+	}
+	ht_entry_release(item);
+}
+#endif
+
+#if HT_HASH == HT_HASH_WY
+// Multiply two words and fold the 128-bit product back into 64 bits
+static inline uint64_t ht_mum(uint64_t a, uint64_t b)
+{
+	__uint128_t product = (__uint128_t)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t ht_read64(const char *p)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+static inline uint64_t ht_read32(const char *p)
+{
+	uint32_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+#endif
+
+/*
+ * Úplná hodnota rozptyľovacej funkcie kľúča dĺžky length.
+ *
+ * Predvolená je funkcia v štýle wyhash, ktorá spracúva kľúč po 8 bajtoch.
+ */
+static uint64_t ht_hash_key(const char *key, size_t length)
+{
+#if HT_HASH == HT_HASH_SUM
+	// Original byte sum, kept for comparison
+	uint64_t result = 1;
+	for (size_t i = 0; i < length; i++)
+	{
+		result += (signed char)key[i];
+	}
+	return result;
+#elif HT_HASH == HT_HASH_FNV1A
+	uint64_t result = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < length; i++)
+	{
+		result ^= (unsigned char)key[i];
+		result *= 0x100000001b3ull;
+	}
+	return result;
+#else
+	const uint64_t secret0 = 0xa0761d6478bd642full;
+	const uint64_t secret1 = 0xe7037ed1a0b428dbull;
+	uint64_t seed = secret0;
+	uint64_t a;
+	uint64_t b;
+
+	if (length <= 16)
+	{
+		if (length >= 4)
+		{
+			// Two overlapping 4-byte reads from each end cover the whole key
+			size_t shift = (length >> 3) << 2;
+			a = (ht_read32(key) << 32) | ht_read32(key + shift);
+			b = (ht_read32(key + length - 4) << 32) |
+				ht_read32(key + length - 4 - shift);
+		}
+		else if (length > 0)
+		{
+			const unsigned char *p = (const unsigned char *)key;
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) |
+				p[length - 1];
+			b = 0;
+		}
+		else
+		{
+			a = b = 0;
+		}
+	}
+	else
+	{
+		// Mix 16 bytes per step, the tail is covered by the last two words
+		const char *p = key;
+		size_t remaining = length;
+		while (remaining > 16)
+		{
+			seed = ht_mum(ht_read64(p) ^ secret1, ht_read64(p + 8) ^ seed);
+			p += 16;
+			remaining -= 16;
+		}
+		a = ht_read64(p + remaining - 16);
+		b = ht_read64(p + remaining - 8);
+	}
+
+	return ht_mum(secret1 ^ length, ht_mum(a ^ secret1, b ^ seed));
+#endif
+}
+
 /*
  * Rozptyľovacia funkcia ktorá pridelí zadanému kľúču index z intervalu
  * <0,HT_SIZE-1>. Ideálna rozptyľovacia funkcia by mala rozprestrieť kľúče
@@ -21,13 +718,101 @@ int HT_SIZE = MAX_HT_SIZE;
  */
 int get_hash(char *key)
 {
-	int result = 1;
-	int length = strlen(key);
-	for (int i = 0; i < length; i++)
+	return (int)(ht_hash_key(key, strlen(key)) % (uint64_t)HT_SIZE);
+}
+
+/*
+ * Počítadlá vyhľadávaní pre ht_get_stats, zapínajú sa prekladom s
+ * -DHT_STATS. Počítadlá sú spoločné pre všetky tabuľky.
+ */
+#ifdef HT_STATS
+static unsigned long ht_stat_hits = 0;
+static unsigned long ht_stat_hit_probes = 0;
+static unsigned long ht_stat_misses = 0;
+static unsigned long ht_stat_miss_probes = 0;
+
+#ifdef HT_CONCURRENT
+#define HT_STAT_ADD(counter, amount) \
+	__atomic_fetch_add(&(counter), (amount), __ATOMIC_RELAXED)
+#else
+#define HT_STAT_ADD(counter, amount) ((counter) += (amount))
+#endif
+#else
+#define HT_STAT_ADD(counter, amount) ((void)0)
+#endif
+
+/*
+ * Vyhľadanie kľúča so známym hashom v zozname synonym začínajúcom item.
+ */
+static ht_item_t *ht_find(ht_item_t *item, const char *key, uint64_t hash)
+{
+#ifdef HT_STATS
+	unsigned long probes = 0;
+#endif
+
+	// Go through all items in the list
+	while (item != NULL)
+	{
+#ifdef HT_STATS
+		probes++;
+#endif
+		// Compare keys only when full hashes match
+		if (HT_ENTRY(item)->hash == hash && strcmp(item->key, key) == 0)
+		{
+			HT_STAT_ADD(ht_stat_hits, 1);
+			HT_STAT_ADD(ht_stat_hit_probes, probes);
+			return item;
+		}
+		// Move onto another
+		item = HT_LOAD(item->next);
+	}
+
+	HT_STAT_ADD(ht_stat_misses, 1);
+	HT_STAT_ADD(ht_stat_miss_probes, probes);
+	return NULL;
+}
+
+/*
+ * Nájdenie alebo vytvorenie položky so známym hashom jedným prechodom
+ * zoznamu. Existujúcej položke sa hodnota prepíše iba ak je overwrite true.
+ *
+ * V prípade úspechu vráti ukazovateľ na položku, pri chybe alokácie NULL.
+ */
+static ht_item_t *ht_probe(ht_table_t *table, const char *key, size_t length,
+						   uint64_t hash, float value, bool overwrite)
+{
+	int index = hash % (uint64_t)HT_SIZE;
+
+	// Writers on the same list are serialized
+	ht_write_lock(index);
+
+	ht_item_t *item = ht_find((*table)[index], key, hash);
+
+	// If item exists, replace its value if asked to
+	if (item != NULL)
+	{
+		if (overwrite)
+		{
+			HT_SET_VALUE(item, value);
+		}
+		ht_write_unlock(index);
+		return item;
+	}
+
+	// Create new item
+	ht_entry_t *newEntry = ht_entry_new(table, key, length, hash);
+	// Malloc fail
+	if (newEntry == NULL)
 	{
-		result += key[i];
+		ht_write_unlock(index);
+		return NULL;
 	}
-	return (result % HT_SIZE);
+	newEntry->item.value = value;
+	newEntry->item.next = (*table)[index];
+	HT_PUBLISH((*table)[index], &newEntry->item);
+	ht_write_unlock(index);
+
+	return &newEntry->item;
 }
 
 /*
@@ -56,25 +841,15 @@ ht_item_t *ht_search(ht_table_t *table, char *key)
 		return NULL;
 	}
 
-	int hash = get_hash(key);
-
-	// Find item based on hash
-	ht_item_t *item = (*table)[hash];
+	uint64_t hash = ht_hash_key(key, strlen(key));
 
 	// Go through all items in the table on the same hash
-	while (item != NULL)
-	{
-		// If found, return the item
-		if (strcmp(item->key, key) == 0)
-		{
-			return item;
-		}
-		// Move onto another
-		item = item->next;
-	}
+	ht_read_begin();
+	ht_item_t *item = ht_find(HT_LOAD((*table)[hash % (uint64_t)HT_SIZE]),
+							  key, hash);
+	ht_read_end();
 
-	// If not found, return NULL
-	return NULL;
+	return item;
 }
 
 /*
@@ -93,33 +868,41 @@ void ht_insert(ht_table_t *table, char *key, float value)
 		return;
 	}
 
+	size_t length = strlen(key);
+	uint64_t hash = ht_hash_key(key, length);
+	int index = hash % (uint64_t)HT_SIZE;
+
+	// Writers on the same list are serialized
+	ht_write_lock(index);
+
 	ht_item_t *item = ht_search(table, key);
 
 	// If item exists, replace its value
 	if (item != NULL)
 	{
-		item->value = value;
+		HT_SET_VALUE(item, value);
+		ht_write_unlock(index);
 		return;
 	}
 
-	int hash = get_hash(key);
-
-	// Create new item
-	ht_item_t *newItem = malloc(sizeof(ht_item_t));
+	// Create new item, the table keeps its own copy of the key
+	ht_entry_t *newEntry = ht_entry_new(table, key, length, hash);
 	
 	// Malloc fail
-	if (newItem == NULL)
+	if (newEntry == NULL)
 	{
+		ht_write_unlock(index);
 		return;
 	}
 
 	// Set values
-	newItem->key = key;
+	ht_item_t *newItem = &newEntry->item;
 	newItem->value = value;
-	newItem->next = (*table)[hash];
+	newItem->next = (*table)[index];
 
-	// Add new item to table
-	(*table)[hash] = newItem;
+	// Add new item to table, readers see it only fully initialized
+	HT_PUBLISH((*table)[index], newItem);
+	ht_write_unlock(index);
 }
 
 /*
@@ -165,31 +948,36 @@ void ht_delete(ht_table_t *table, char *key)
 		return;
 	}
 
-	int hash = get_hash(key);
+	uint64_t hash = ht_hash_key(key, strlen(key));
+	int index = hash % (uint64_t)HT_SIZE;
+
+	// Writers on the same list are serialized
+	ht_write_lock(index);
 
 	// Find item based on hash
-	ht_item_t *item = (*table)[hash];
+	ht_item_t *item = (*table)[index];
 	ht_item_t *prev = NULL;
 
 	// Go through all items in the table on the same hash
 	while (item != NULL)
 	{
 		// If found, delete it
-		if (strcmp(item->key, key) == 0)
+		if (HT_ENTRY(item)->hash == hash && strcmp(item->key, key) == 0)
 		{
 			// If it's the first item in the list
 			if (prev == NULL)
 			{	
 				// Set the next to be first
-				(*table)[hash] = item->next;
+				HT_PUBLISH((*table)[index], item->next);
 			}
 			// If it's not the first
 			else
 			{
 				// Step over the deleted item
-				prev->next = item->next;
+				HT_PUBLISH(prev->next, item->next);
 			}
-			free(item);
+			ht_write_unlock(index);
+			ht_retire(item, item->next);
 			return;
 		}
 
@@ -197,6 +985,8 @@ void ht_delete(ht_table_t *table, char *key)
 		prev = item;
 		item = item->next;
 	}
+
+	ht_write_unlock(index);
 }
 
 /*
@@ -213,22 +1003,583 @@ void ht_delete_all(ht_table_t *table)
 		return;
 	}
 
+#if defined(HT_SLAB) && !defined(HT_CONCURRENT)
+	// Every item lives in the table's arena, drop it in one step
+	ht_arena_t *arena = *ht_arena_link(table);
+	if (arena != NULL)
+	{
+		ht_arena_free(arena);
+	}
+	ht_init(table);
+#else
 	ht_item_t *item;
-	ht_item_t *next;
 
 	// Go through all items in the table
 	for (int i = 0; i < HT_SIZE; i++)
 	{
+		// Detach the list and set it to NULL
+		ht_write_lock(i);
 		item = (*table)[i];
-		
-		// Go through all items in the list
-		while (item != NULL)
+		HT_PUBLISH((*table)[i], NULL);
+		ht_write_unlock(i);
+
+		// Release the whole list
+		ht_retire(item, NULL);
+	}
+
+#ifdef HT_SLAB
+	// Readers may still walk the detached lists, so the arena is freed
+	// with its last retired entry and the next insert starts a new one
+	pthread_mutex_lock(&ht_slab_lock);
+	ht_arena_t **link = ht_arena_link(table);
+	ht_arena_t *arena = *link;
+	if (arena != NULL)
+	{
+		*link = arena->next;
+		arena->table = NULL;
+		if (arena->live_entries == 0)
 		{
-			next = item->next;
-			free(item);
-			item = next;
+			ht_arena_free(arena);
 		}
-		// Set the list to NULL
-		(*table)[i] = NULL;
 	}
+	pthread_mutex_unlock(&ht_slab_lock);
+#endif
+#endif
+}
+
+/*
+ * Hromadné vyhľadanie kľúčov.
+ *
+ * Kľúče sa spracúvajú po skupinách HT_BATCH. Najprv sa pre celú skupinu
+ * spočítajú hashe a prednačítajú sa začiatky zoznamov, potom prvé položky
+ * a až nakoniec sa prechádzajú zoznamy, takže sa čakanie na pamäť prekrýva.
+ */
+#ifndef HT_BATCH
+#define HT_BATCH 16
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HT_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define HT_PREFETCH(address) ((void)(address))
+#endif
+
+void ht_get_batch(ht_table_t *table, char **keys, int count, float **values)
+{
+	uint64_t hashes[HT_BATCH];
+	ht_item_t *heads[HT_BATCH];
+
+	// Return if table is empty or there are no keys
+	if (table == NULL || keys == NULL || values == NULL)
+	{
+		return;
+	}
+
+	for (int start = 0; start < count; start += HT_BATCH)
+	{
+		int size = count - start < HT_BATCH ? count - start : HT_BATCH;
+
+		// Hash all keys and prefetch their buckets
+		for (int i = 0; i < size; i++)
+		{
+			char *key = keys[start + i];
+			hashes[i] = 0;
+			if (key != NULL)
+			{
+				hashes[i] = ht_hash_key(key, strlen(key));
+				HT_PREFETCH(&(*table)[hashes[i] % (uint64_t)HT_SIZE]);
+			}
+		}
+
+		ht_read_begin();
+
+		// Load bucket heads and prefetch the first items
+		for (int i = 0; i < size; i++)
+		{
+			heads[i] = NULL;
+			if (keys[start + i] != NULL)
+			{
+				heads[i] = HT_LOAD((*table)[hashes[i] % (uint64_t)HT_SIZE]);
+				if (heads[i] != NULL)
+				{
+					HT_PREFETCH(HT_ENTRY(heads[i]));
+				}
+			}
+		}
+
+		// Walk the lists
+		for (int i = 0; i < size; i++)
+		{
+			ht_item_t *item = ht_find(heads[i], keys[start + i], hashes[i]);
+			values[start + i] = item != NULL ? &item->value : NULL;
+		}
+
+		ht_read_end();
+	}
+}
+
+/*
+ * Hromadné vloženie dvojíc kľúč-hodnota.
+ *
+ * Prednačítanie prebieha rovnako ako pri ht_get_batch, položky sa potom
+ * vkladajú v poradí poľa, takže opakovaný kľúč dostane poslednú hodnotu.
+ */
+void ht_insert_batch(ht_table_t *table, char **keys, float *values, int count)
+{
+	size_t lengths[HT_BATCH];
+	uint64_t hashes[HT_BATCH];
+
+	// Return if table is empty or there are no keys
+	if (table == NULL || keys == NULL || values == NULL)
+	{
+		return;
+	}
+
+	for (int start = 0; start < count; start += HT_BATCH)
+	{
+		int size = count - start < HT_BATCH ? count - start : HT_BATCH;
+
+		// Hash all keys and prefetch their buckets
+		for (int i = 0; i < size; i++)
+		{
+			char *key = keys[start + i];
+			if (key != NULL)
+			{
+				lengths[i] = strlen(key);
+				hashes[i] = ht_hash_key(key, lengths[i]);
+				HT_PREFETCH(&(*table)[hashes[i] % (uint64_t)HT_SIZE]);
+			}
+		}
+
+		// Prefetch the first items
+		for (int i = 0; i < size; i++)
+		{
+			if (keys[start + i] != NULL)
+			{
+				ht_item_t *head = (*table)[hashes[i] % (uint64_t)HT_SIZE];
+				if (head != NULL)
+				{
+					HT_PREFETCH(HT_ENTRY(head));
+				}
+			}
+		}
+
+		// Insert or update in array order
+		for (int i = 0; i < size; i++)
+		{
+			char *key = keys[start + i];
+			if (key != NULL)
+			{
+				ht_probe(table, key, lengths[i], hashes[i], values[start + i],
+						 true);
+			}
+		}
+	}
+}
+
+/*
+ * Vloženie alebo prepísanie hodnoty jedným vyhľadaním.
+ *
+ * Na rozdiel od ht_insert sa kľúč hashuje a zoznam prechádza iba raz.
+ * V prípade úspechu vráti ukazovateľ na hodnotu prvku, pri chybe alokácie
+ * hodnotu NULL.
+ */
+float *ht_upsert(ht_table_t *table, char *key, float value)
+{
+	// Return NULL if table is empty or key doesn't exist
+	if (table == NULL || key == NULL)
+	{
+		return NULL;
+	}
+
+	size_t length = strlen(key);
+	ht_item_t *item = ht_probe(table, key, length, ht_hash_key(key, length),
+							   value, true);
+
+	return item != NULL ? &item->value : NULL;
+}
+
+/*
+ * Získanie hodnoty, pričom chýbajúci kľúč sa vloží s hodnotou value.
+ *
+ * Existujúca hodnota sa nemení, takže vrátený ukazovateľ možno použiť napr.
+ * na priame zvýšenie počítadla. Pri chybe alokácie vráti hodnotu NULL.
+ */
+float *ht_get_or_insert(ht_table_t *table, char *key, float value)
+{
+	// Return NULL if table is empty or key doesn't exist
+	if (table == NULL || key == NULL)
+	{
+		return NULL;
+	}
+
+	size_t length = strlen(key);
+	ht_item_t *item = ht_probe(table, key, length, ht_hash_key(key, length),
+							   value, false);
+
+	return item != NULL ? &item->value : NULL;
+}
+
+/*
+ * Štatistiky stavu tabuľky.
+ *
+ * Počet položiek, naplnenie a dĺžky zoznamov sa zisťujú prechodom tabuľky.
+ * Priemerný počet porovnaní pri úspešnom a neúspešnom vyhľadaní je dostupný
+ * iba pri preklade s -DHT_STATS, inak je nulový.
+ */
+void ht_get_stats(ht_table_t *table, ht_stats_t *stats)
+{
+	// Return if table or output is empty
+	if (table == NULL || stats == NULL)
+	{
+		return;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	ht_read_begin();
+
+	// Go through all lists in the table
+	for (int i = 0; i < HT_SIZE; i++)
+	{
+		int length = 0;
+		for (ht_item_t *item = HT_LOAD((*table)[i]); item != NULL;
+			 item = HT_LOAD(item->next))
+		{
+			length++;
+		}
+
+		stats->items += length;
+		if (length > stats->longest_chain)
+		{
+			stats->longest_chain = length;
+		}
+		// Last histogram bucket collects all longer lists
+		stats->chain_histogram[length < HT_STATS_HISTOGRAM
+								   ? length
+								   : HT_STATS_HISTOGRAM - 1]++;
+	}
+
+	ht_read_end();
+
+	stats->load_factor = (float)stats->items / HT_SIZE;
+
+#ifdef HT_STATS
+	stats->hits = __atomic_load_n(&ht_stat_hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&ht_stat_misses, __ATOMIC_RELAXED);
+	if (stats->hits > 0)
+	{
+		stats->hit_probes = (float)__atomic_load_n(&ht_stat_hit_probes,
+												   __ATOMIC_RELAXED) /
+							stats->hits;
+	}
+	if (stats->misses > 0)
+	{
+		stats->miss_probes = (float)__atomic_load_n(&ht_stat_miss_probes,
+													__ATOMIC_RELAXED) /
+							 stats->misses;
+	}
+#endif
+}
+
+/*
+ * Vynulovanie počítadiel vyhľadávaní.
+ */
+void ht_reset_stats(void)
+{
+#ifdef HT_STATS
+	__atomic_store_n(&ht_stat_hits, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ht_stat_hit_probes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ht_stat_misses, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ht_stat_miss_probes, 0, __ATOMIC_RELAXED);
+#endif
+}
+
+/*
+ * Obraz tabuľky v súbore, zapína sa prekladom s -DHT_IMAGE.
+ *
+ * Súbor začína hlavičkou, za ňou nasleduje pole offsetov začiatkov zoznamov
+ * a samotné záznamy. Namiesto ukazovateľov sa ukladajú offsety od začiatku
+ * súboru, 0 znamená koniec zoznamu, takže súbor možno namapovať na ľubovoľnú
+ * adresu a vyhľadávať v ňom bez prestavby tabuľky. Záznam obsahuje aj úplný
+ * hash kľúča, preto súbor platí iba pre rovnakú funkciu HT_HASH. Čísla sú
+ * v poradí bajtov stroja, ktorý súbor zapísal.
+ */
+#ifdef HT_IMAGE
+#define HT_IMAGE_MAGIC 0x48544149u
+#define HT_IMAGE_VERSION 2u
+#define HT_IMAGE_BYTE_ORDER 0x01020304u
+
+typedef struct ht_image_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t hash_function;
+	uint32_t buckets;
+	uint32_t items;
+	uint64_t size;
+	uint32_t checksum;
+	uint32_t header_checksum;
+} ht_image_header_t;
+
+typedef struct ht_image_record
+{
+	uint64_t hash;
+	uint64_t next;
+	uint32_t length;
+	float value;
+	char key[];
+} ht_image_record_t;
+
+// Records start on 8-byte boundaries
+#define HT_IMAGE_ALIGN(size) (((size) + 7) & ~(size_t)7)
+#define HT_IMAGE_RECORD(length) \
+	HT_IMAGE_ALIGN(offsetof(ht_image_record_t, key) + (length) + 1)
+#define HT_IMAGE_BUCKETS(image) \
+	((const uint64_t *)((image)->data + sizeof(ht_image_header_t)))
+
+// FNV-1a over size bytes of data
+static uint32_t ht_image_checksum(const unsigned char *data, size_t size)
+{
+	uint32_t result = 0x811c9dc5u;
+	for (size_t i = 0; i < size; i++)
+	{
+		result ^= data[i];
+		result *= 0x01000193u;
+	}
+	return result;
+}
+
+// The header checksum covers the header with its own field zeroed
+static uint32_t ht_image_header_checksum(ht_image_header_t header)
+{
+	header.header_checksum = 0;
+	return ht_image_checksum((const unsigned char *)&header, sizeof(header));
+}
+
+/*
+ * Zápis tabuľky do súboru path.
+ *
+ * Obraz sa poskladá v pamäti a zapíše naraz, zoznamy si ponechajú poradie
+ * z tabuľky. Počas zápisu sa tabuľka nesmie meniť. Pri chybe vráti false.
+ */
+bool ht_image_save(ht_table_t *table, const char *path)
+{
+	// Return if table is empty
+	if (table == NULL || path == NULL)
+	{
+		return false;
+	}
+
+	// Size the image first
+	size_t size = HT_IMAGE_ALIGN(sizeof(ht_image_header_t) +
+								 HT_SIZE * sizeof(uint64_t));
+	uint32_t items = 0;
+	for (int i = 0; i < HT_SIZE; i++)
+	{
+		for (ht_item_t *item = (*table)[i]; item != NULL; item = item->next)
+		{
+			size += HT_IMAGE_RECORD(strlen(item->key));
+			items++;
+		}
+	}
+
+	unsigned char *image = calloc(size, 1);
+	// Malloc fail
+	if (image == NULL)
+	{
+		return false;
+	}
+
+	// Lay out each list in order, so a record's next is the one after it
+	uint64_t *buckets = (uint64_t *)(image + sizeof(ht_image_header_t));
+	size_t offset = HT_IMAGE_ALIGN(sizeof(ht_image_header_t) +
+								   HT_SIZE * sizeof(uint64_t));
+	for (int i = 0; i < HT_SIZE; i++)
+	{
+		buckets[i] = (*table)[i] != NULL ? offset : 0;
+		for (ht_item_t *item = (*table)[i]; item != NULL; item = item->next)
+		{
+			ht_image_record_t *record = (ht_image_record_t *)(image + offset);
+			size_t length = strlen(item->key);
+
+			offset += HT_IMAGE_RECORD(length);
+			record->hash = HT_ENTRY(item)->hash;
+			record->next = item->next != NULL ? offset : 0;
+			record->length = length;
+			record->value = item->value;
+			memcpy(record->key, item->key, length + 1);
+		}
+	}
+
+	ht_image_header_t header = {
+		.magic = HT_IMAGE_MAGIC,
+		.version = HT_IMAGE_VERSION,
+		.byte_order = HT_IMAGE_BYTE_ORDER,
+		.hash_function = HT_HASH,
+		.buckets = HT_SIZE,
+		.items = items,
+		.size = size,
+		.checksum = ht_image_checksum(image + sizeof(ht_image_header_t),
+									  size - sizeof(ht_image_header_t)),
+	};
+	header.header_checksum = ht_image_header_checksum(header);
+	memcpy(image, &header, sizeof(header));
+
+	FILE *file = fopen(path, "wb");
+	bool written = file != NULL && fwrite(image, 1, size, file) == size;
+	if (file != NULL && fclose(file) != 0)
+	{
+		written = false;
+	}
+
+	free(image);
+	return written;
+}
+
+/*
+ * Namapovanie obrazu tabuľky zo súboru path iba na čítanie.
+ *
+ * Overí sa iba hlavička a jej kontrolný súčet, takže namapovanie trvá rovnako
+ * dlho pri akejkoľvek veľkosti súboru. Súbor inej verzie, inej rozptyľovacej
+ * funkcie alebo s poškodenou hlavičkou vráti false. Záznamy overí až
+ * ht_image_verify.
+ */
+bool ht_image_map(const char *path, ht_image_t *image)
+{
+	// Return if there is nothing to map into
+	if (path == NULL || image == NULL)
+	{
+		return false;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 ||
+		info.st_size < (off_t)sizeof(ht_image_header_t))
+	{
+		close(fd);
+		return false;
+	}
+
+	size_t size = info.st_size;
+	unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	ht_image_header_t header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != HT_IMAGE_MAGIC ||
+		header.version != HT_IMAGE_VERSION ||
+		header.byte_order != HT_IMAGE_BYTE_ORDER ||
+		header.hash_function != HT_HASH || header.size != size ||
+		header.buckets == 0 ||
+		header.buckets > (size - sizeof(header)) / sizeof(uint64_t) ||
+		header.header_checksum != ht_image_header_checksum(header))
+	{
+		munmap(data, size);
+		return false;
+	}
+
+	image->data = data;
+	image->size = size;
+	image->buckets = header.buckets;
+	image->items = header.items;
+	return true;
+}
+
+/*
+ * Overenie kontrolného súčtu všetkých záznamov namapovaného obrazu.
+ *
+ * Prejde celý súbor, preto sa volá iba pri súboroch z nedôveryhodného zdroja
+ * alebo pri hľadaní poškodenia. Ak súčet nesedí, vráti false.
+ */
+bool ht_image_verify(const ht_image_t *image)
+{
+	// Return if nothing is mapped
+	if (image == NULL || image->data == NULL)
+	{
+		return false;
+	}
+
+	ht_image_header_t header;
+	memcpy(&header, image->data, sizeof(header));
+	return header.checksum ==
+		   ht_image_checksum(image->data + sizeof(header),
+							 image->size - sizeof(header));
+}
+
+/*
+ * Vyhľadanie hodnoty v namapovanom obraze.
+ *
+ * V prípade úspechu vráti ukazovateľ na hodnotu v súbore, v opačnom prípade
+ * hodnotu NULL. Offsety sa pri prechode kontrolujú voči veľkosti súboru
+ * a musia rásť, takže ani neoverený súbor nespôsobí čítanie mimo neho
+ * ani zacyklenie.
+ */
+const float *ht_image_get(const ht_image_t *image, const char *key)
+{
+	// Return NULL if image is empty or key doesn't exist
+	if (image == NULL || image->data == NULL || key == NULL)
+	{
+		return NULL;
+	}
+
+	size_t length = strlen(key);
+	uint64_t hash = ht_hash_key(key, length);
+	uint64_t offset = HT_IMAGE_BUCKETS(image)[hash % image->buckets];
+	size_t end = image->size - offsetof(ht_image_record_t, key);
+
+	// Go through the list while records stay inside the file
+	while (offset != 0 && offset % 8 == 0 && offset <= end)
+	{
+		const ht_image_record_t *record =
+			(const ht_image_record_t *)(image->data + offset);
+
+		// Compare keys only when full hashes match
+		if (record->hash == hash && record->length == length &&
+			length < end - offset &&
+			memcmp(record->key, key, length + 1) == 0)
+		{
+			return &record->value;
+		}
+		// Lists are laid out in order, a backward offset means corruption
+		if (record->next != 0 && record->next <= offset)
+		{
+			return NULL;
+		}
+		offset = record->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Zrušenie mapovania obrazu.
+ */
+void ht_image_unmap(ht_image_t *image)
+{
+	// Return if nothing is mapped
+	if (image == NULL || image->data == NULL)
+	{
+		return;
+	}
+
+	munmap((void *)image->data, image->size);
+	image->data = NULL;
+	image->size = 0;
+	image->buckets = 0;
+	image->items = 0;
 }
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Rozšírenia tabuľky s rozptýlenými položkami nad rámec rozhrania
+ * hashtable.h.
+ */
+
+#ifndef IAL_HASHTABLE_EXT_H
+#define IAL_HASHTABLE_EXT_H
+
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Počet tried histogramu dĺžok zoznamov, posledná trieda obsahuje aj všetky
+ * dlhšie zoznamy.
+ */
+#define HT_STATS_HISTOGRAM 16
+
+/*
+ * Štatistiky stavu tabuľky.
+ */
+typedef struct ht_stats
+{
+	int items;
+	float load_factor;
+	int longest_chain;
+	int chain_histogram[HT_STATS_HISTOGRAM];
+	unsigned long hits;
+	unsigned long misses;
+	float hit_probes;
+	float miss_probes;
+} ht_stats_t;
+
+/*
+ * Tabuľka namapovaná zo súboru funkciou ht_image_map.
+ */
+typedef struct ht_image
+{
+	const unsigned char *data;
+	size_t size;
+	unsigned buckets;
+	unsigned items;
+} ht_image_t;
+
+/*
+ * Hromadné vyhľadanie count kľúčov; values[i] bude rovnaké ako
+ * ht_get(table, keys[i]).
+ */
+void ht_get_batch(ht_table_t *table, char **keys, int count, float **values);
+
+/*
+ * Hromadné vloženie count dvojíc kľúč-hodnota v poradí poľa, ako keby sa
+ * volalo ht_insert pre každú z nich.
+ */
+void ht_insert_batch(ht_table_t *table, char **keys, float *values, int count);
+
+/*
+ * Vloženie alebo prepísanie hodnoty jedným vyhľadaním, vráti ukazovateľ na
+ * hodnotu prvku.
+ */
+float *ht_upsert(ht_table_t *table, char *key, float value);
+
+/*
+ * Ukazovateľ na hodnotu prvku; chýbajúci kľúč sa najprv vloží s hodnotou
+ * value.
+ */
+float *ht_get_or_insert(ht_table_t *table, char *key, float value);
+
+/*
+ * Naplnenie štatistík tabuľky; počítadlá vyhľadávaní sú k dispozícii iba pri
+ * preklade s -DHT_STATS.
+ */
+void ht_get_stats(ht_table_t *table, ht_stats_t *stats);
+
+/*
+ * Vynulovanie počítadiel vyhľadávaní.
+ */
+void ht_reset_stats(void);
+
+/*
+ * Zápis tabuľky do súboru a jeho namapovanie iba na čítanie. Súbor obsahuje
+ * offsety namiesto ukazovateľov, verziu formátu a kontrolné súčty, takže
+ * vyhľadávanie môže začať hneď po namapovaní bez vkladania položiek.
+ * ht_image_map overí iba hlavičku, celý súbor prejde až ht_image_verify.
+ *
+ * Iba v režime HT_IMAGE.
+ */
+bool ht_image_save(ht_table_t *table, const char *path);
+bool ht_image_map(const char *path, ht_image_t *image);
+bool ht_image_verify(const ht_image_t *image);
+const float *ht_image_get(const ht_image_t *image, const char *key);
+void ht_image_unmap(ht_image_t *image);
+
+#endif